@@ -0,0 +1,187 @@
+/*
+** binding.c is the native baseline of bench/binding.js. It makes the same
+** sqlite3 calls as each of the Javascript benchmarks, by the same names,
+** directly from C and prints a JSON array of { name, ns, mallocs } to stdout,
+** where ns is the cost of an operation in nanoseconds and mallocs the number
+** of allocations sqlite3 made per operation.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sqlite3.h>
+
+static const int aSize[] = { 8, 64, 1024, 16384 };
+static const int aWidth[] = { 1, 4, 16, 64 };
+static const char *azMix[] = { "int", "double", "text", "mixed" };
+static const char *azType[] = { "int", "double", "text", "null" };
+
+/* state shared by the benchmark operations */
+static struct {
+  sqlite3 *db;              /* UTF-8 connection */
+  sqlite3 *db16;            /* UTF-16 connection */
+  sqlite3_stmt *pStmt;      /* Statement the current operation works on */
+  const void *pValue;       /* Value bound by the current operation */
+  int nValue;               /* Size of pValue in bytes */
+  int bUtf16;               /* True to read text as UTF-16 */
+  sqlite3_int64 nMalloc;    /* Number of allocations made */
+  sqlite3_mem_methods mem;  /* The default allocator */
+  int bFirst;               /* False after the first result is printed */
+} g;
+
+/* count allocations on top of the default allocator */
+static void *countingMalloc(int n){ g.nMalloc++; return g.mem.xMalloc(n); }
+static void *countingRealloc(void *p, int n){ g.nMalloc++; return g.mem.xRealloc(p, n); }
+
+static sqlite3_int64 clockNs(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (sqlite3_int64)ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+
+/* the operations, one per kind of benchmark in binding.js */
+static void opCall(void){ sqlite3_libversion_number(); }
+static void opPrepare(void){
+  sqlite3_stmt *p;
+  sqlite3_prepare_v3(g.db, "SELECT 1", -1, 0, &p, 0);
+  sqlite3_finalize(p);
+}
+static void opBindInt(void){ sqlite3_bind_int64(g.pStmt, 1, 42); }
+static void opBindDouble(void){ sqlite3_bind_double(g.pStmt, 1, 4.2); }
+static void opBindText(void){ sqlite3_bind_text(g.pStmt, 1, g.pValue, g.nValue, SQLITE_TRANSIENT); }
+static void opBindText16(void){ sqlite3_bind_text16(g.pStmt, 1, g.pValue, g.nValue, SQLITE_TRANSIENT); }
+static void opBindBlob(void){ sqlite3_bind_blob(g.pStmt, 1, g.pValue, g.nValue, SQLITE_TRANSIENT); }
+static void opStep(void){ sqlite3_step(g.pStmt); }
+static void opGet(void){
+  /* like Statement#get(): every column by it's type; text and blobs are read, not copied */
+  volatile double r;
+  volatile const void *z;
+  volatile int n;
+  int i, nCol = sqlite3_data_count(g.pStmt);
+  for(i=0; i<nCol; i++){
+    switch( sqlite3_column_type(g.pStmt, i) ){
+      case SQLITE_INTEGER:
+      case SQLITE_FLOAT: r = sqlite3_column_double(g.pStmt, i); break;
+      case SQLITE_TEXT:
+        z = g.bUtf16 ? sqlite3_column_text16(g.pStmt, i) : (const void*)sqlite3_column_text(g.pStmt, i);
+        n = g.bUtf16 ? sqlite3_column_bytes16(g.pStmt, i) : sqlite3_column_bytes(g.pStmt, i);
+        break;
+      case SQLITE_BLOB:
+        z = sqlite3_column_blob(g.pStmt, i);
+        n = sqlite3_column_bytes(g.pStmt, i);
+        break;
+    }
+  }
+  (void)r; (void)z; (void)n;
+}
+
+/*
+** Run xOp for at least 50ms, after warming it up for as long, and print it's result as zName
+*/
+static void measure(const char *zName, void (*xOp)(void)){
+  sqlite3_int64 i, n = 1, iStart, nMalloc;
+  double ns;
+  for(iStart=clockNs(); clockNs()-iStart < 50000000; n*=2){
+    for(i=0; i<n; i++) xOp();
+  }
+  nMalloc = g.nMalloc;
+  iStart = clockNs();
+  for(i=0; i<n; i++) xOp();
+  ns = (double)(clockNs() - iStart) / n;
+  printf("%s\n  { \"name\": \"%s\", \"ns\": %.1f, \"mallocs\": %.2f }",
+    g.bFirst ? "" : ",", zName, ns, (double)(g.nMalloc - nMalloc) / n);
+  g.bFirst = 0;
+}
+
+/* value of column j of a row with the type mix zMix, as an SQL literal */
+static void literal(char *zBuf, int nBuf, const char *zMix, int j){
+  const char *zType = strcmp(zMix, "mixed")==0 ? azType[j%4] : zMix;
+  if( strcmp(zType, "int")==0 ) snprintf(zBuf, nBuf, "%d", j + 1);
+  else if( strcmp(zType, "double")==0 ) snprintf(zBuf, nBuf, "%d.5", j);
+  else if( strcmp(zType, "text")==0 ) snprintf(zBuf, nBuf, "'column value %d'", j);
+  else snprintf(zBuf, nBuf, "NULL");
+}
+
+int main(void){
+  sqlite3_mem_methods counting;
+  sqlite3_stmt *pBind, *pBind16;
+  char zName[64], zSql[4096];
+  int i, j, k, e;
+
+  sqlite3_config(SQLITE_CONFIG_GETMALLOC, &g.mem);
+  counting = g.mem;
+  counting.xMalloc = countingMalloc;
+  counting.xRealloc = countingRealloc;
+  sqlite3_config(SQLITE_CONFIG_MALLOC, &counting);
+  if( sqlite3_initialize()!=SQLITE_OK ) return 1;
+
+  /* the same connections as binding.js: in-memory, the second one storing text as UTF-16 */
+  sqlite3_open_v2(":memory:", &g.db, SQLITE_OPEN_READWRITE|SQLITE_OPEN_MEMORY, 0);
+  sqlite3_open_v2(":memory:", &g.db16, SQLITE_OPEN_READWRITE|SQLITE_OPEN_MEMORY, 0);
+  sqlite3_exec(g.db16, "PRAGMA encoding = 'UTF-16le'", 0, 0, 0);
+
+  g.bFirst = 1;
+  printf("[");
+  measure("call", opCall);
+  measure("prepare", opPrepare);
+
+  sqlite3_prepare_v3(g.db, "SELECT ?", -1, 0, &pBind, 0);
+  sqlite3_prepare_v3(g.db16, "SELECT ?", -1, 0, &pBind16, 0);
+  g.pStmt = pBind;
+  measure("bind int", opBindInt);
+  measure("bind double", opBindDouble);
+  for(i=0; i<(int)(sizeof(aSize)/sizeof(aSize[0])); i++){
+    int n = aSize[i];
+    char *zText = malloc(n);
+    unsigned short *zText16 = malloc(n*2);
+    memset(zText, 'x', n);
+    for(j=0; j<n; j++) zText16[j] = 'x';
+
+    g.pStmt = pBind; g.pValue = zText; g.nValue = n;
+    snprintf(zName, sizeof(zName), "bind text utf8 %d", n);
+    measure(zName, opBindText);
+    g.pStmt = pBind16; g.pValue = zText16; g.nValue = n*2;
+    snprintf(zName, sizeof(zName), "bind text utf16 %d", n);
+    measure(zName, opBindText16);
+    g.pStmt = pBind; g.pValue = zText; g.nValue = n;
+    snprintf(zName, sizeof(zName), "bind blob %d", n);
+    measure(zName, opBindBlob);
+
+    sqlite3_clear_bindings(pBind);
+    sqlite3_clear_bindings(pBind16);
+    free(zText);
+    free(zText16);
+  }
+  sqlite3_finalize(pBind);
+  sqlite3_finalize(pBind16);
+
+  sqlite3_prepare_v3(g.db, "WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x+1 FROM c) SELECT x FROM c", -1, 0, &g.pStmt, 0);
+  measure("step", opStep);
+  sqlite3_finalize(g.pStmt);
+
+  for(e=0; e<2; e++){
+    g.bUtf16 = e;
+    for(i=0; i<4; i++){
+      if( e && strcmp(azMix[i], "text")!=0 ) continue; /* the encoding only matters to text */
+      for(k=0; k<(int)(sizeof(aWidth)/sizeof(aWidth[0])); k++){
+        int n = (int)strlen(strcpy(zSql, "SELECT "));
+        for(j=0; j<aWidth[k]; j++){
+          if( j>0 ) n += (int)strlen(strcpy(&zSql[n], ", "));
+          literal(&zSql[n], (int)sizeof(zSql)-n, azMix[i], j);
+          n += (int)strlen(&zSql[n]);
+        }
+        sqlite3_prepare_v3(e ? g.db16 : g.db, zSql, -1, 0, &g.pStmt, 0);
+        sqlite3_step(g.pStmt);
+        snprintf(zName, sizeof(zName), "get %s %sx%d", azMix[i], e ? "utf16 " : "", aWidth[k]);
+        measure(zName, opGet);
+        sqlite3_finalize(g.pStmt);
+      }
+    }
+  }
+  printf("\n]\n");
+
+  sqlite3_close(g.db);
+  sqlite3_close(g.db16);
+  return 0;
+}
@@ -0,0 +1,135 @@
+/*
+** binding.js measures the cost of the Javascript binding layer in isolation:
+** a trivial call into wasm, prepare, binding values of every type and size,
+** stepping and reading rows of varying width and type mix with get(). Every
+** benchmark has a counterpart in binding.c, which makes the same calls natively,
+** so that the report shows what the binding adds on top of sqlite3 itself.
+**
+** usage: node --expose-gc binding.js --wasm FILE [--native FILE] [--report FILE] [--filter REGEX]
+**
+** Results are in nanoseconds per operation. bytes is the Javascript heap allocated
+** per operation (needs --expose-gc); mallocs, for the native baseline, is the number
+** of sqlite3 allocations per operation.
+*/
+
+import * as _ from 'lodash';
+import fs from 'fs';
+import { execFileSync } from 'child_process';
+import { load, open } from '../lib/index';
+import sqlite3 from '../lib/sqlite3';
+
+// sizes, in characters / bytes, of the text and blob values bound
+const SIZES = [ 8, 64, 1024, 16384 ];
+
+// widths of the rows read by get(), and the type mix of their columns; mixed rows cycle through TYPES
+const WIDTHS = [ 1, 4, 16, 64 ];
+const MIXES = [ 'int', 'double', 'text', 'mixed' ];
+const TYPES = [ 'int', 'double', 'text', 'null' ];
+
+// clock returns a monotonic timestamp in nanoseconds
+const clock = () => Number(process.hrtime.bigint());
+
+// measure runs op repeatedly for at least 50ms, after warming it up for as long, and returns it's cost in nanoseconds per op
+// and, if the garbage collector is exposed, the bytes it allocates on the Javascript heap per op
+const measure = op => {
+  let n = 1;
+  for(let start = clock(); clock() - start < 50e6; n *= 2) {
+    for(let i = 0; i < n; i++) op();
+  }
+
+  const start = clock();
+  for(let i = 0; i < n; i++) op();
+  const ns = (clock() - start) / n;
+
+  let bytes = null;
+  if(typeof gc === 'function') {
+    const count = 1000; // few enough to fit in the young generation without a scavenge
+    gc(); // eslint-disable-line no-undef
+    const before = process.memoryUsage().heapUsed;
+    for(let i = 0; i < count; i++) op();
+    bytes = Math.max(process.memoryUsage().heapUsed - before, 0) / count;
+  }
+  return { ns: _.round(ns, 1), bytes: bytes === null ? null : _.round(bytes, 1) };
+}
+
+// value returns the value of column j of a row with the given type mix
+const value = (mix, j) => {
+  switch(mix === 'mixed' ? TYPES[j % 4] : mix) {
+    case 'int': return j + 1;
+    case 'double': return j + 0.5;
+    case 'text': return `column value ${j}`;
+    default: return null;
+  }
+}
+
+// suite returns the benchmarks as a list of [ name, op ], with op set up against the connections
+const suite = (utf8, utf16) => {
+  const benchmarks = [];
+  const add = (name, op) => benchmarks.push([ name, op ]);
+
+  add('call', () => sqlite3.sqlite3_libversion_number());
+  add('prepare', () => utf8.prepare('SELECT 1').finalize());
+
+  const bind = utf8.prepare('SELECT ?');
+  const bind16 = utf16.prepare('SELECT ?');
+  add('bind int', () => bind.bindParams([ 42 ]));
+  add('bind double', () => bind.bindParams([ 4.2 ]));
+  SIZES.forEach(size => {
+    const text = 'x'.repeat(size), blob = new Uint8Array(size).fill(7);
+    add(`bind text utf8 ${size}`, () => bind.bindParams([ text ]));
+    add(`bind text utf16 ${size}`, () => bind16.bindParams([ text ]));
+    add(`bind blob ${size}`, () => bind.bindParams([ blob ]));
+  });
+
+  const step = utf8.prepare('WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x+1 FROM c) SELECT x FROM c');
+  add('step', () => step.step());
+
+  [ [ 'utf8', utf8 ], [ 'utf16', utf16 ] ].forEach(([ encoding, connection ]) => {
+    MIXES.forEach(mix => WIDTHS.forEach(width => {
+      if(encoding === 'utf16' && mix !== 'text') return; // the encoding only matters to text
+      const values = _.times(width, j => value(mix, j));
+      const stmt = connection.prepare(`SELECT ${values.map(v => v === null ? 'NULL' : (_.isString(v) ? `'${v}'` : String(v))).join(', ')}`);
+      stmt.step();
+      add(`get ${mix} ${encoding === 'utf16' ? 'utf16 ' : ''}x${width}`, () => stmt.get());
+    }));
+  });
+
+  return benchmarks;
+}
+
+// options parses the command line into an object of --name value pairs
+const options = argv => {
+  const opts = {};
+  for(let i = 0; i < argv.length; i += 2) opts[argv[i].replace(/^--/, '')] = argv[i + 1];
+  return opts;
+}
+
+const { wasm, native, report: reportFile, filter } = options(process.argv.slice(2));
+if(!wasm) {
+  console.error('usage: node --expose-gc binding.js --wasm FILE [--native FILE] [--report FILE] [--filter REGEX]');
+  process.exit(2);
+}
+
+load(fs.readFileSync(wasm));
+const utf8 = open(null, {}), utf16 = open(null, { text: 'utf16' });
+const pattern = new RegExp(filter || '.');
+
+// the native baseline reports a JSON array of { name, ns, mallocs }
+const baseline = native ? _.keyBy(JSON.parse(execFileSync(native, [], { encoding: 'utf8' })), 'name') : {};
+
+const results = suite(utf8, utf16).filter(([ name ]) => pattern.test(name)).map(([ name, op ]) => {
+  const js = measure(op);
+  const base = baseline[name];
+  const entry = { name, js };
+  if(base) {
+    entry.native = _.pick(base, 'ns', 'mallocs');
+    entry.ratio = base.ns > 0 ? _.round(js.ns / base.ns, 1) : null;
+  }
+  console.error(`${_.padEnd(name, 28)} ${_.padStart(js.ns, 10)} ns/op ${_.padStart(js.bytes === null ? '-' : js.bytes, 8)} B/op` +
+    (base ? `   native ${_.padStart(base.ns, 8)} ns/op ${_.padStart(base.mallocs, 5)} mallocs/op  x${entry.ratio}` : ''));
+  return entry;
+});
+
+const json = JSON.stringify({ date: new Date().toISOString(), node: process.version, results }, null, 2);
+if(reportFile) fs.writeFileSync(reportFile, json);
+else console.log(json);
@@ -0,0 +1,119 @@
+/*
+** speedtest1.js runs sqlite3's speedtest1 workload headless under Node: the
+** wasm build (linked against the same objects and wasm vfs as dist/sqlite3.wasm,
+** running on lib/wasi.js and lib/environment.js) and, if given, the native build
+** of the same configuration. It writes a JSON report with the timings of every
+** test of both and the wasm / native ratio. See the speedtest1 target of the Makefile.
+**
+** usage: node speedtest1.js --wasm FILE [--native FILE] [--report FILE] [-- speedtest1 options]
+*/
+
+import * as _ from 'lodash';
+import fs from 'fs';
+import os from 'os';
+import { execFileSync } from 'child_process';
+import WASI from '../lib/wasi';
+import * as environment from '../lib/environment';
+import { memory } from '../lib/sqlite3';
+
+// matches the line speedtest1 prints for each test, as in " 100 - 50000 INSERTs into table with no index.....   0.071s"
+const TEST = /^\s*(\d+) - (.*?)\.*\s+(\d+\.\d+)s\s*$/;
+
+// matches the line with the total time of all tests
+const TOTAL = /^\s+TOTAL\.*\s+(\d+\.\d+)s\s*$/;
+
+// parse extracts the tests and total time, in milliseconds, from the output of speedtest1
+const parse = output => {
+  const tests = [];
+  let total = null;
+  output.split('\n').forEach(line => {
+    let m;
+    if((m = TEST.exec(line)) !== null) {
+      tests.push({ id: Number(m[1]), name: m[2].trim(), time: Math.round(Number(m[3]) * 1000) });
+    } else if((m = TOTAL.exec(line)) !== null) {
+      total = Math.round(Number(m[1]) * 1000);
+    }
+  });
+  return { tests, total };
+}
+
+// wasm runs the wasm build of speedtest1 with args and returns it's output
+const wasm = (file, args) => {
+  let output = '';
+  const module = new WebAssembly.Module(fs.readFileSync(file));
+  const wasi = new WASI(memory, {}, {
+    args: [ 'speedtest1', ...args ],
+    stdout: text => { output += text },
+    stderr: text => process.stderr.write(text),
+  });
+
+  // anything else the program imports (syscalls it never needs for an in-memory database) is stubbed out
+  const env = { ...environment, emscripten_notify_memory_growth: _.noop, memory };
+  WebAssembly.Module.imports(module).forEach(({ module: ns, name, kind }) => {
+    if(ns === 'env' && kind === 'function' && env[name] === undefined) {
+      env[name] = () => {
+        console.error(`speedtest1: unimplemented call to ${name}`);
+        return -52; // -ENOSYS
+      };
+    }
+  });
+
+  const instance = new WebAssembly.Instance(module, _.merge({}, wasi.imports, { env }));
+  const code = wasi.start(instance);
+  if(code !== 0) {
+    throw new Error(`speedtest1.wasm exited with code ${code}\n${output}`);
+  }
+  return output;
+}
+
+// native runs the native build of speedtest1 with args and returns it's output
+const native = (file, args) => execFileSync(file, args, { encoding: 'utf8', maxBuffer: 64 << 20 });
+
+// options splits the command line into the runner's options and speedtest1's
+const options = argv => {
+  const split = argv.indexOf('--');
+  const own = split >= 0 ? argv.slice(0, split) : argv;
+  const opts = { args: split >= 0 ? argv.slice(split + 1) : [ '--memdb', '--size', '50' ] };
+  for(let i = 0; i < own.length; i += 2) {
+    opts[own[i].replace(/^--/, '')] = own[i + 1];
+  }
+  return opts;
+}
+
+const { wasm: wasmFile, native: nativeFile, report: reportFile, args } = options(process.argv.slice(2));
+if(!wasmFile) {
+  console.error('usage: node speedtest1.js --wasm FILE [--native FILE] [--report FILE] [-- speedtest1 options]');
+  process.exit(2);
+}
+
+const results = { wasm: parse(wasm(wasmFile, args)) };
+if(nativeFile) {
+  results.native = parse(native(nativeFile, args));
+}
+
+const report = {
+  date: new Date().toISOString(),
+  node: process.version,
+  platform: `${os.platform()} ${os.arch()} (${os.cpus()[0].model})`,
+  args,
+  total: _.mapValues(results, 'total'),
+  tests: results.wasm.tests.map(({ id, name, time }) => {
+    const entry = { id, name, wasm: time };
+    const other = results.native && _.find(results.native.tests, { id });
+    if(other) {
+      entry.native = other.time;
+      entry.ratio = other.time > 0 ? _.round(time / other.time, 2) : null;
+    }
+    return entry;
+  }),
+};
+if(results.native && results.native.total > 0) {
+  report.ratio = _.round(results.wasm.total / results.native.total, 2);
+}
+
+const json = JSON.stringify(report, null, 2);
+if(reportFile) fs.writeFileSync(reportFile, json);
+else console.log(json);
+
+report.tests.forEach(t => console.error(`${_.padStart(t.id, 4)} ${_.padEnd(t.name.slice(0, 60), 60)} ${_.padStart(t.wasm, 7)}ms${t.native !== undefined ? ` ${_.padStart(t.native, 7)}ms  x${t.ratio}` : ''}`));
+console.error(`     TOTAL ${_.padStart(report.total.wasm, 61)}ms${report.ratio !== undefined ? ` ${_.padStart(report.total.native, 7)}ms  x${report.ratio}` : ''}`);
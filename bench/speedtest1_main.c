@@ -0,0 +1,32 @@
+/*
+** speedtest1_main.c is the entrypoint of the speedtest1 benchmark builds
+** (see the speedtest1 targets of the Makefile). speedtest1.c is compiled with
+** it's main() renamed to speedtest1_main, so that the library can be set up
+** the way the rest of the build expects before the workload runs.
+*/
+
+#include <stdio.h>
+#include <sqlite3.h>
+
+extern int speedtest1_main(int argc, char **argv);
+
+/*
+** Keep temporary tables and indices in memory. There are no files to spill
+** them to in the wasm vfs, and the native build must behave the same.
+*/
+static int speedtest1TempStore(sqlite3 *db, char **pzErrMsg, const sqlite3_api_routines *pApi) {
+  (void)pApi;
+  return sqlite3_exec(db, "PRAGMA temp_store=MEMORY", 0, 0, pzErrMsg);
+}
+
+int main(int argc, char **argv) {
+  /* the library is built with SQLITE_OMIT_AUTOINIT, so it has to be initialized
+  ** explicitly; speedtest1's --heap, --pcache and --lookaside options can't be used */
+  int rc = sqlite3_initialize();
+  if( rc!=SQLITE_OK ){
+    fprintf(stderr, "failed to initialize sqlite3: %s\n", sqlite3_errstr(rc));
+    return 1;
+  }
+  sqlite3_auto_extension((void(*)(void))speedtest1TempStore);
+  return speedtest1_main(argc, argv);
+}
@@ -0,0 +1,24 @@
+//- Webpack bundler configuration for the benchmark runners
+
+const path = require('path');
+
+module.exports = {
+  target: 'node',
+  mode: 'production',
+
+  // a runner per benchmark
+  entry: {
+    speedtest1: path.resolve(__dirname, './speedtest1.js'),
+    binding: path.resolve(__dirname, './binding.js'),
+  },
+
+  output: {
+    path: path.resolve(__dirname, '../build/bench'),
+    filename: '[name].js',
+  },
+  resolve: {
+    alias: {
+      'lodash': 'lodash-es'
+    }
+  },
+};
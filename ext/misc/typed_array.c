@@ -0,0 +1,725 @@
+/*
+** 2026-10-18
+**
+** The author disclaims copyright to this source code.  In place of
+** a legal notice, here is a blessing:
+**
+**    May you do good and not evil.
+**    May you find forgiveness for yourself and forgive others.
+**    May you share freely, never taking more than you give.
+**
+*************************************************************************
+**
+** This file implements the typed_array virtual table, which exposes
+** columnar arrays owned by the application, without copying them, as
+** the columns of a read-only table.
+**
+** HOW IT WORKS
+**
+** The application describes its arrays with sqlite3_typed_array_register(),
+** giving them a name:
+**
+**    typed_array_column aCol[2] = {
+**      { "x", TYPED_ARRAY_FLOAT64, aX, 0 },
+**      { "label", TYPED_ARRAY_TEXT, zLabels, aLabelOffsets },
+**    };
+**    sqlite3_typed_array_register("points", nPoint, 2, aCol);
+**
+** and then creates a virtual table over them by that name:
+**
+**    CREATE VIRTUAL TABLE temp.points USING typed_array(points);
+**    INSERT INTO stored_points SELECT * FROM temp.points;
+**    SELECT avg(x) FROM temp.points WHERE rowid BETWEEN 1000 AND 2000;
+**
+** The registry only keeps the description of the arrays. The arrays
+** themselves are read in place and must outlive every statement that
+** scans the table. They can be re-registered under the same name (for
+** instance with a different number of rows) at any time; every scan uses
+** the description registered at the time it starts, which is kept alive
+** until the scan is done.
+**
+** Row i of the arrays has rowid i+1. Column types are:
+**
+**    TYPED_ARRAY_INT32     aData is an array of 32-bit integers
+**    TYPED_ARRAY_INT64     aData is an array of 64-bit integers
+**    TYPED_ARRAY_FLOAT64   aData is an array of doubles
+**    TYPED_ARRAY_TEXT      aData holds the UTF-8 bytes of all values back
+**                          to back and aOffset nRow+1 offsets into it,
+**                          value i spanning [aOffset[i], aOffset[i+1]).
+**                          The offset of a NULL value is stored negated,
+**                          as ~aOffset[i]
+**    TYPED_ARRAY_BLOB      like TYPED_ARRAY_TEXT, for blobs
+**
+** xBestIndex pushes rowid equality and ranges down into the scan, which
+** then only visits the rows in range, and consumes ORDER BY rowid in either
+** direction. Equality constraints on columns are checked in xNext, before
+** a row is ever handed to the virtual machine.
+*/
+#include "sqlite3ext.h"
+SQLITE_EXTENSION_INIT1
+#include <assert.h>
+#include <string.h>
+
+#ifndef SQLITE_OMIT_VIRTUALTABLE
+
+/* Column types */
+#define TYPED_ARRAY_INT32    1
+#define TYPED_ARRAY_INT64    2
+#define TYPED_ARRAY_FLOAT64  3
+#define TYPED_ARRAY_TEXT     4
+#define TYPED_ARRAY_BLOB     5
+
+/* Offset of value i of a TEXT or BLOB column, and whether the value is NULL */
+#define TYPED_ARRAY_OFFSET(a, i)  ((a)[i]<0 ? ~(a)[i] : (a)[i])
+#define TYPED_ARRAY_ISNULL(a, i)  ((a)[i]<0)
+
+/*
+** typed_array_column describes a single column of a registered array.
+** Every field is 4 bytes wide on wasm32, so the Javascript side can fill it
+** in as 4 consecutive 32-bit words.
+*/
+typedef struct typed_array_column typed_array_column;
+struct typed_array_column {
+  const char *zName;         /* Name of the column */
+  int eType;                 /* One of the TYPED_ARRAY_* types */
+  const void *aData;         /* Values, or bytes of TEXT and BLOB values */
+  const int *aOffset;        /* TEXT and BLOB: nRow+1 offsets into aData */
+};
+
+/*
+** typed_array is a registered set of arrays. Registered arrays form a
+** singly-linked list.
+*/
+typedef struct typed_array typed_array;
+struct typed_array {
+  char *zName;               /* Name the arrays are registered as */
+  int nRow;                  /* Number of rows */
+  int nCol;                  /* Number of columns */
+  typed_array_column *aCol;  /* Copy of the column descriptions */
+  int nRef;                  /* Number of cursors scanning the arrays */
+  int bRemoved;              /* True once unregistered or replaced */
+  typed_array *pNext;        /* Next registered array */
+};
+
+static typed_array *typedArrayList = 0;
+
+/*
+** Find the arrays registered as zName, or NULL
+*/
+static typed_array *typedArrayFind(const char *zName){
+  typed_array *p;
+  for(p=typedArrayList; p; p=p->pNext){
+    if( sqlite3_stricmp(p->zName, zName)==0 ) return p;
+  }
+  return 0;
+}
+
+/*
+** Release a typed_array and its copies of the descriptions
+*/
+static void typedArrayFree(typed_array *p){
+  int i;
+  if( p==0 ) return;
+  for(i=0; i<p->nCol; i++) sqlite3_free((char*)p->aCol[i].zName);
+  sqlite3_free(p->aCol);
+  sqlite3_free(p->zName);
+  sqlite3_free(p);
+}
+
+/*
+** Release the reference a cursor holds on the arrays it scans
+*/
+static void typedArrayRelease(typed_array *p){
+  if( p==0 ) return;
+  p->nRef--;
+  if( p->nRef==0 && p->bRemoved ) typedArrayFree(p);
+}
+
+/*
+** Remove the arrays registered as zName from the registry. Virtual tables
+** over them fail to scan until they're registered again. Returns SQLITE_OK
+** or SQLITE_NOTFOUND if no arrays were registered as zName.
+*/
+int sqlite3_typed_array_unregister(const char *zName){
+  typed_array **pp;
+  for(pp=&typedArrayList; *pp; pp=&(*pp)->pNext){
+    if( sqlite3_stricmp((*pp)->zName, zName)==0 ){
+      typed_array *p = *pp;
+      *pp = p->pNext;
+      p->bRemoved = 1;
+      if( p->nRef==0 ) typedArrayFree(p); /* else freed by the last cursor */
+      return SQLITE_OK;
+    }
+  }
+  return SQLITE_NOTFOUND;
+}
+
+/*
+** Register nCol arrays of nRow rows each, described by aCol, as zName,
+** replacing any arrays previously registered with the same name. Only the
+** descriptions are copied; the arrays must stay around until they are
+** unregistered (or replaced) and no longer scanned.
+*/
+int sqlite3_typed_array_register(const char *zName, int nRow, int nCol, const typed_array_column *aCol){
+  typed_array *p;
+  int i;
+
+  if( zName==0 || nRow<0 || nCol<=0 || aCol==0 ) return SQLITE_MISUSE;
+  for(i=0; i<nCol; i++){
+    if( aCol[i].zName==0 || aCol[i].eType<TYPED_ARRAY_INT32 || aCol[i].eType>TYPED_ARRAY_BLOB ) return SQLITE_MISUSE;
+    if( nRow>0 && aCol[i].aData==0 ) return SQLITE_MISUSE;
+    if( aCol[i].eType>=TYPED_ARRAY_TEXT && aCol[i].aOffset==0 ) return SQLITE_MISUSE;
+  }
+
+  p = sqlite3_malloc(sizeof(*p));
+  if( p==0 ) return SQLITE_NOMEM;
+  memset(p, 0, sizeof(*p));
+  p->zName = sqlite3_mprintf("%s", zName);
+  p->aCol = sqlite3_malloc64(sizeof(typed_array_column)*nCol);
+  if( p->zName==0 || p->aCol==0 ){
+    typedArrayFree(p);
+    return SQLITE_NOMEM;
+  }
+  p->nRow = nRow;
+  for(i=0; i<nCol; i++){
+    p->aCol[i] = aCol[i];
+    p->aCol[i].zName = sqlite3_mprintf("%s", aCol[i].zName);
+    p->nCol++;
+    if( p->aCol[i].zName==0 ){
+      typedArrayFree(p);
+      return SQLITE_NOMEM;
+    }
+  }
+
+  sqlite3_typed_array_unregister(zName);
+  p->pNext = typedArrayList;
+  typedArrayList = p;
+  return SQLITE_OK;
+}
+
+/* typed_array_vtab is a virtual table over registered arrays. It only
+** remembers their name; the description is looked up on every use.
+*/
+typedef struct typed_array_vtab typed_array_vtab;
+struct typed_array_vtab {
+  sqlite3_vtab base;         /* Base class - must be first */
+  char *zArray;              /* Name the arrays are registered as */
+  int nCol;                  /* Number of columns declared */
+};
+
+/* typed_array_match is an equality constraint checked by the cursor
+*/
+typedef struct typed_array_match typed_array_match;
+struct typed_array_match {
+  int iCol;                  /* Column constrained */
+  int eType;                 /* SQLITE_INTEGER, SQLITE_FLOAT or SQLITE_TEXT */
+  sqlite3_int64 iValue;      /* SQLITE_INTEGER */
+  double rValue;             /* SQLITE_FLOAT */
+  char *zValue;              /* SQLITE_TEXT and SQLITE_BLOB; from sqlite3_malloc */
+  int nValue;                /* Bytes in zValue */
+};
+
+/* typed_array_cursor is a cursor that scans rows of a typed_array_vtab
+*/
+typedef struct typed_array_cursor typed_array_cursor;
+struct typed_array_cursor {
+  sqlite3_vtab_cursor base;  /* Base class - must be first */
+  typed_array *pArray;       /* Arrays being scanned */
+  sqlite3_int64 iRow;        /* Current row; rowid is iRow+1 */
+  sqlite3_int64 iFirst;      /* First row in range */
+  sqlite3_int64 iLast;       /* Last row in range */
+  int isDesc;                /* True to scan from iLast down to iFirst */
+  int nMatch;                /* Number of equality constraints */
+  typed_array_match *aMatch; /* Equality constraints checked on every row */
+};
+
+/*
+** The typedArrayConnect() method is invoked to create a new
+** typed_array_vtab over the arrays named by the (single) module argument.
+** The columns are declared from the registered description.
+*/
+static int typedArrayConnect(
+  sqlite3 *db,
+  void *pAux,
+  int argc, const char *const*argv,
+  sqlite3_vtab **ppVtab,
+  char **pzErr
+){
+  typed_array_vtab *pNew;
+  typed_array *pArray;
+  sqlite3_str *pSql;
+  char *zSql;
+  int i, rc;
+
+  (void)pAux;
+  if( argc!=4 ){
+    *pzErr = sqlite3_mprintf("usage: CREATE VIRTUAL TABLE t USING typed_array(name)");
+    return SQLITE_ERROR;
+  }
+  pArray = typedArrayFind(argv[3]);
+  if( pArray==0 ){
+    *pzErr = sqlite3_mprintf("no typed array registered as %s", argv[3]);
+    return SQLITE_ERROR;
+  }
+
+  pSql = sqlite3_str_new(db);
+  sqlite3_str_appendall(pSql, "CREATE TABLE x(");
+  for(i=0; i<pArray->nCol; i++){
+    const char *zType;
+    switch( pArray->aCol[i].eType ){
+      case TYPED_ARRAY_FLOAT64: zType = "REAL";    break;
+      case TYPED_ARRAY_TEXT:    zType = "TEXT";    break;
+      case TYPED_ARRAY_BLOB:    zType = "BLOB";    break;
+      default:                  zType = "INTEGER"; break;
+    }
+    sqlite3_str_appendf(pSql, "%s\"%w\" %s", i>0 ? "," : "", pArray->aCol[i].zName, zType);
+  }
+  sqlite3_str_appendall(pSql, ")");
+  zSql = sqlite3_str_finish(pSql);
+  if( zSql==0 ) return SQLITE_NOMEM;
+
+  rc = sqlite3_declare_vtab(db, zSql);
+  sqlite3_free(zSql);
+  if( rc==SQLITE_OK ){
+    pNew = sqlite3_malloc( sizeof(*pNew) );
+    if( pNew==0 ) return SQLITE_NOMEM;
+    memset(pNew, 0, sizeof(*pNew));
+    pNew->zArray = sqlite3_mprintf("%s", argv[3]);
+    pNew->nCol = pArray->nCol;
+    if( pNew->zArray==0 ){
+      sqlite3_free(pNew);
+      return SQLITE_NOMEM;
+    }
+    *ppVtab = &pNew->base;
+  }
+  return rc;
+}
+
+/*
+** This method is the destructor for typed_array_vtab objects.
+*/
+static int typedArrayDisconnect(sqlite3_vtab *pVtab){
+  typed_array_vtab *p = (typed_array_vtab*)pVtab;
+  sqlite3_free(p->zArray);
+  sqlite3_free(p);
+  return SQLITE_OK;
+}
+
+/*
+** Constructor for a new typed_array_cursor object.
+*/
+static int typedArrayOpen(sqlite3_vtab *pUnused, sqlite3_vtab_cursor **ppCursor){
+  typed_array_cursor *pCur;
+  (void)pUnused;
+  pCur = sqlite3_malloc( sizeof(*pCur) );
+  if( pCur==0 ) return SQLITE_NOMEM;
+  memset(pCur, 0, sizeof(*pCur));
+  *ppCursor = &pCur->base;
+  return SQLITE_OK;
+}
+
+/*
+** Release the equality constraints of a cursor
+*/
+static void typedArrayClearMatches(typed_array_cursor *pCur){
+  int i;
+  for(i=0; i<pCur->nMatch; i++) sqlite3_free(pCur->aMatch[i].zValue);
+  sqlite3_free(pCur->aMatch);
+  pCur->aMatch = 0;
+  pCur->nMatch = 0;
+}
+
+/*
+** Destructor for a typed_array_cursor.
+*/
+static int typedArrayClose(sqlite3_vtab_cursor *cur){
+  typed_array_cursor *pCur = (typed_array_cursor*)cur;
+  typedArrayClearMatches(pCur);
+  typedArrayRelease(pCur->pArray);
+  sqlite3_free(cur);
+  return SQLITE_OK;
+}
+
+/*
+** Return TRUE if the cursor has been moved off of the last row in range.
+*/
+static int typedArrayEof(sqlite3_vtab_cursor *cur){
+  typed_array_cursor *pCur = (typed_array_cursor*)cur;
+  return pCur->iRow<pCur->iFirst || pCur->iRow>pCur->iLast;
+}
+
+/*
+** Return TRUE if row iRow satisfies every equality constraint of the cursor
+*/
+static int typedArrayMatches(typed_array_cursor *pCur, sqlite3_int64 iRow){
+  int i;
+  for(i=0; i<pCur->nMatch; i++){
+    typed_array_match *m = &pCur->aMatch[i];
+    const typed_array_column *pCol = &pCur->pArray->aCol[m->iCol];
+    switch( pCol->eType ){
+      case TYPED_ARRAY_INT32:
+      case TYPED_ARRAY_INT64: {
+        sqlite3_int64 v = pCol->eType==TYPED_ARRAY_INT32 ?
+          ((const int*)pCol->aData)[iRow] : ((const sqlite3_int64*)pCol->aData)[iRow];
+        if( m->eType==SQLITE_INTEGER ? v!=m->iValue : (double)v!=m->rValue ) return 0;
+        break;
+      }
+      case TYPED_ARRAY_FLOAT64: {
+        double v = ((const double*)pCol->aData)[iRow];
+        if( m->eType==SQLITE_INTEGER ? v!=(double)m->iValue : v!=m->rValue ) return 0;
+        break;
+      }
+      default: {
+        int iOff = TYPED_ARRAY_OFFSET(pCol->aOffset, iRow);
+        int n = TYPED_ARRAY_OFFSET(pCol->aOffset, iRow+1) - iOff;
+        if( TYPED_ARRAY_ISNULL(pCol->aOffset, iRow) || n!=m->nValue ) return 0;
+        if( n>0 && memcmp((const char*)pCol->aData + iOff, m->zValue, n)!=0 ) return 0;
+        break;
+      }
+    }
+  }
+  return 1;
+}
+
+/*
+** Advance a typed_array_cursor to the next row in range that satisfies
+** the equality constraints, starting with the current one.
+*/
+static void typedArraySeek(typed_array_cursor *pCur){
+  if( pCur->nMatch==0 ) return;
+  while( !typedArrayEof(&pCur->base) && !typedArrayMatches(pCur, pCur->iRow) ){
+    pCur->iRow += pCur->isDesc ? -1 : 1;
+  }
+}
+
+/*
+** Advance a typed_array_cursor to its next row of output.
+*/
+static int typedArrayNext(sqlite3_vtab_cursor *cur){
+  typed_array_cursor *pCur = (typed_array_cursor*)cur;
+  pCur->iRow += pCur->isDesc ? -1 : 1;
+  typedArraySeek(pCur);
+  return SQLITE_OK;
+}
+
+/*
+** Return values of columns for the row at which the typed_array_cursor
+** is currently pointing. TEXT and BLOB values are not copied.
+*/
+static int typedArrayColumn(
+  sqlite3_vtab_cursor *cur,   /* The cursor */
+  sqlite3_context *ctx,       /* First argument to sqlite3_result_...() */
+  int i                       /* Which column to return */
+){
+  typed_array_cursor *pCur = (typed_array_cursor*)cur;
+  const typed_array_column *pCol;
+  sqlite3_int64 iRow = pCur->iRow;
+  if( i<0 || i>=pCur->pArray->nCol ) return SQLITE_OK;
+
+  pCol = &pCur->pArray->aCol[i];
+  switch( pCol->eType ){
+    case TYPED_ARRAY_INT32:   sqlite3_result_int(ctx, ((const int*)pCol->aData)[iRow]); break;
+    case TYPED_ARRAY_INT64:   sqlite3_result_int64(ctx, ((const sqlite3_int64*)pCol->aData)[iRow]); break;
+    case TYPED_ARRAY_FLOAT64: sqlite3_result_double(ctx, ((const double*)pCol->aData)[iRow]); break;
+    default: {
+      int iOff = TYPED_ARRAY_OFFSET(pCol->aOffset, iRow);
+      int n = TYPED_ARRAY_OFFSET(pCol->aOffset, iRow+1) - iOff;
+      const char *z = (const char*)pCol->aData + iOff;
+      if( TYPED_ARRAY_ISNULL(pCol->aOffset, iRow) ){
+        sqlite3_result_null(ctx);
+      }else if( pCol->eType==TYPED_ARRAY_TEXT ){
+        sqlite3_result_text(ctx, z, n, SQLITE_STATIC);
+      }else{
+        sqlite3_result_blob(ctx, z, n, SQLITE_STATIC);
+      }
+      break;
+    }
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Return the rowid for the current row, which is its index plus one.
+*/
+static int typedArrayRowid(sqlite3_vtab_cursor *cur, sqlite_int64 *pRowid){
+  typed_array_cursor *pCur = (typed_array_cursor*)cur;
+  *pRowid = pCur->iRow + 1;
+  return SQLITE_OK;
+}
+
+/*
+** Bits of idxNum. Rowid constraints and then the equality constraints on
+** columns (whose numbers are listed in idxStr, separated by commas) are
+** passed on to typedArrayFilter in that order.
+*/
+#define TYPED_ARRAY_ROWID_EQ   0x01   /* rowid = $value */
+#define TYPED_ARRAY_ROWID_GT   0x02   /* rowid > $value */
+#define TYPED_ARRAY_ROWID_GE   0x04   /* rowid >= $value */
+#define TYPED_ARRAY_ROWID_LT   0x08   /* rowid < $value */
+#define TYPED_ARRAY_ROWID_LE   0x10   /* rowid <= $value */
+#define TYPED_ARRAY_DESC       0x20   /* output in descending order of rowid */
+
+/*
+** Narrow the range of rows [*piFirst, *piLast] of the cursor, of arrays with nRow
+** rows, given the constraint rowid OP pVal. Bounds are computed conservatively, as
+** sqlite3 still checks the constraint itself on every row.
+*/
+static void typedArrayNarrow(
+  int op, sqlite3_value *pVal, sqlite3_int64 nRow,
+  sqlite3_int64 *piFirst, sqlite3_int64 *piLast
+){
+  int eType = sqlite3_value_numeric_type(pVal);
+  sqlite3_int64 iFloor, iCeil;   /* Floor and ceiling of the value, within [0, nRow+1] */
+
+  if( eType==SQLITE_NULL ){
+    *piLast = *piFirst - 1;      /* comparisons with NULL are never true */
+    return;
+  }
+  if( eType==SQLITE_INTEGER ){
+    sqlite3_int64 v = sqlite3_value_int64(pVal);
+    if( v<0 ) v = 0;
+    if( v>nRow+1 ) v = nRow+1;
+    iFloor = iCeil = v;
+  }else if( eType==SQLITE_FLOAT ){
+    double r = sqlite3_value_double(pVal);
+    if( !(r>=0.0) ) r = 0.0;
+    if( r>(double)(nRow+1) ) r = (double)(nRow+1);
+    iFloor = (sqlite3_int64)r;
+    iCeil = (double)iFloor<r ? iFloor+1 : iFloor;
+  }else{
+    return;                      /* leave text and blobs to sqlite3 */
+  }
+
+  /* rowids are row indexes plus one */
+  switch( op ){
+    case TYPED_ARRAY_ROWID_EQ:
+      if( iFloor!=iCeil ){
+        *piLast = *piFirst - 1;
+      }else{
+        if( iFloor-1>*piFirst ) *piFirst = iFloor-1;
+        if( iFloor-1<*piLast ) *piLast = iFloor-1;
+      }
+      break;
+    case TYPED_ARRAY_ROWID_GT: if( iFloor>*piFirst ) *piFirst = iFloor;     break;
+    case TYPED_ARRAY_ROWID_GE: if( iCeil-1>*piFirst ) *piFirst = iCeil-1;   break;
+    case TYPED_ARRAY_ROWID_LT: if( iCeil-2<*piLast ) *piLast = iCeil-2;     break;
+    case TYPED_ARRAY_ROWID_LE: if( iFloor-1<*piLast ) *piLast = iFloor-1;   break;
+  }
+}
+
+/*
+** Prepare the equality constraint column iCol = pVal for checking by the
+** cursor. Returns 0 if the constraint can't be checked in C (comparing values
+** of different types relies on affinity), in which case it's left to sqlite3,
+** and -1 if it can never be true.
+*/
+static int typedArrayMatchInit(typed_array_match *m, const typed_array_column *pCol, int iCol, sqlite3_value *pVal){
+  int eType = sqlite3_value_type(pVal);
+  memset(m, 0, sizeof(*m));
+  m->iCol = iCol;
+  if( eType==SQLITE_NULL ) return -1;
+
+  switch( pCol->eType ){
+    case TYPED_ARRAY_INT32:
+    case TYPED_ARRAY_INT64:
+    case TYPED_ARRAY_FLOAT64:
+      if( eType!=SQLITE_INTEGER && eType!=SQLITE_FLOAT ) return 0;
+      m->eType = eType;
+      m->iValue = sqlite3_value_int64(pVal);
+      m->rValue = sqlite3_value_double(pVal);
+      return 1;
+    default:
+      if( eType!=(pCol->eType==TYPED_ARRAY_TEXT ? SQLITE_TEXT : SQLITE_BLOB) ) return 0;
+      m->eType = eType;
+      m->nValue = sqlite3_value_bytes(pVal);
+      m->zValue = sqlite3_malloc(m->nValue+1);
+      if( m->zValue==0 ) return -2;
+      if( m->nValue>0 ) memcpy(m->zValue, eType==SQLITE_TEXT ? (const void*)sqlite3_value_text(pVal) : sqlite3_value_blob(pVal), m->nValue);
+      return 1;
+  }
+}
+
+/*
+** This method is called to "rewind" the typed_array_cursor object back
+** to the first row of output, given the plan chosen by typedArrayBestIndex.
+** The registered description is looked up afresh, so that the scan sees
+** arrays re-registered since the table was created.
+*/
+static int typedArrayFilter(
+  sqlite3_vtab_cursor *pVtabCursor,
+  int idxNum, const char *idxStr,
+  int argc, sqlite3_value **argv
+){
+  typed_array_cursor *pCur = (typed_array_cursor*)pVtabCursor;
+  typed_array_vtab *pTab = (typed_array_vtab*)pVtabCursor->pVtab;
+  typed_array *pArray;
+  int i = 0, op;
+
+  typedArrayClearMatches(pCur);
+  typedArrayRelease(pCur->pArray);
+  pCur->pArray = 0;
+  pArray = typedArrayFind(pTab->zArray);
+  if( pArray==0 || pArray->nCol!=pTab->nCol ){
+    sqlite3_free(pTab->base.zErrMsg);
+    pTab->base.zErrMsg = sqlite3_mprintf(pArray==0 ?
+        "no typed array registered as %s" : "typed array %s changed shape", pTab->zArray);
+    pCur->iFirst = 0;
+    pCur->iLast = -1;
+    pCur->iRow = 0;
+    return SQLITE_ERROR;
+  }
+
+  pCur->pArray = pArray;
+  pArray->nRef++;
+  pCur->iFirst = 0;
+  pCur->iLast = pArray->nRow - 1;
+  for(op=TYPED_ARRAY_ROWID_EQ; op<=TYPED_ARRAY_ROWID_LE; op<<=1){
+    if( (idxNum & op) && i<argc ){
+      typedArrayNarrow(op, argv[i++], pArray->nRow, &pCur->iFirst, &pCur->iLast);
+    }
+  }
+
+  if( idxStr && i<argc ){
+    pCur->aMatch = sqlite3_malloc64(sizeof(typed_array_match)*(argc-i));
+    if( pCur->aMatch==0 ) return SQLITE_NOMEM;
+    while( i<argc && *idxStr ){
+      int iCol = 0, rc;
+      while( *idxStr>='0' && *idxStr<='9' ) iCol = iCol*10 + (*idxStr++ - '0');
+      if( *idxStr==',' ) idxStr++;
+      if( iCol>=pArray->nCol ) break;
+
+      rc = typedArrayMatchInit(&pCur->aMatch[pCur->nMatch], &pArray->aCol[iCol], iCol, argv[i++]);
+      if( rc==-2 ) return SQLITE_NOMEM;
+      if( rc==-1 ){ pCur->iFirst = 0; pCur->iLast = -1; }
+      if( rc==1 ) pCur->nMatch++;
+    }
+  }
+
+  pCur->isDesc = (idxNum & TYPED_ARRAY_DESC)!=0;
+  pCur->iRow = pCur->isDesc ? pCur->iLast : pCur->iFirst;
+  typedArraySeek(pCur);
+  return SQLITE_OK;
+}
+
+/*
+** SQLite will invoke this method one or more times while planning a query
+** that uses a typed_array virtual table. Rowid equality and range constraints
+** bound the scan; equality constraints on columns are checked by the cursor.
+** Every constraint is still verified by sqlite3 (omit is never set), so the
+** cursor only needs to be conservative, not exact.
+*/
+static int typedArrayBestIndex(
+  sqlite3_vtab *pVTab,
+  sqlite3_index_info *pIdxInfo
+){
+  typed_array_vtab *pTab = (typed_array_vtab*)pVTab;
+  typed_array *pArray = typedArrayFind(pTab->zArray);
+  double nRow = pArray ? (double)pArray->nRow : 1000000.0;
+  int aRowid[5];             /* Constraint used for each rowid op, in idxNum bit order */
+  int idxNum = 0, nArg = 0, i;
+  sqlite3_str *pStr = 0;
+
+  for(i=0; i<5; i++) aRowid[i] = -1;
+  for(i=0; i<pIdxInfo->nConstraint; i++){
+    const struct sqlite3_index_constraint *pCons = &pIdxInfo->aConstraint[i];
+    int k = -1;
+    if( !pCons->usable || pCons->iColumn>=0 ) continue;
+    switch( pCons->op ){
+      case SQLITE_INDEX_CONSTRAINT_EQ: k = 0; break;
+      case SQLITE_INDEX_CONSTRAINT_GT: k = 1; break;
+      case SQLITE_INDEX_CONSTRAINT_GE: k = 2; break;
+      case SQLITE_INDEX_CONSTRAINT_LT: k = 3; break;
+      case SQLITE_INDEX_CONSTRAINT_LE: k = 4; break;
+    }
+    if( k>=0 && aRowid[k]<0 ) aRowid[k] = i;
+  }
+  for(i=0; i<5; i++){
+    if( aRowid[i]>=0 ){
+      idxNum |= 1<<i;
+      pIdxInfo->aConstraintUsage[aRowid[i]].argvIndex = ++nArg;
+    }
+  }
+  if( idxNum & TYPED_ARRAY_ROWID_EQ ){
+    nRow = 1;
+  }else{
+    if( idxNum & (TYPED_ARRAY_ROWID_GT|TYPED_ARRAY_ROWID_GE) ) nRow /= 2;
+    if( idxNum & (TYPED_ARRAY_ROWID_LT|TYPED_ARRAY_ROWID_LE) ) nRow /= 2;
+  }
+  pIdxInfo->estimatedCost = nRow + 1;
+
+  for(i=0; i<pIdxInfo->nConstraint; i++){
+    const struct sqlite3_index_constraint *pCons = &pIdxInfo->aConstraint[i];
+    const char *zColl;
+    if( !pCons->usable || pCons->iColumn<0 || pCons->op!=SQLITE_INDEX_CONSTRAINT_EQ ) continue;
+    zColl = sqlite3_vtab_collation(pIdxInfo, i);
+    if( zColl && sqlite3_stricmp(zColl, "BINARY")!=0 ) continue;
+
+    if( pStr==0 ) pStr = sqlite3_str_new(0);
+    sqlite3_str_appendf(pStr, "%s%d", sqlite3_str_length(pStr)>0 ? "," : "", pCons->iColumn);
+    pIdxInfo->aConstraintUsage[i].argvIndex = ++nArg;
+    nRow /= 10;
+  }
+  if( pStr ){
+    pIdxInfo->idxStr = sqlite3_str_finish(pStr);
+    if( pIdxInfo->idxStr==0 ) return SQLITE_NOMEM;
+    pIdxInfo->needToFreeIdxStr = 1;
+  }
+  pIdxInfo->estimatedRows = nRow<1 ? 1 : (sqlite3_int64)nRow;
+
+  if( pIdxInfo->nOrderBy==1 && pIdxInfo->aOrderBy[0].iColumn<0 ){
+    if( pIdxInfo->aOrderBy[0].desc ) idxNum |= TYPED_ARRAY_DESC;
+    pIdxInfo->orderByConsumed = 1;
+  }
+  pIdxInfo->idxNum = idxNum;
+  return SQLITE_OK;
+}
+
+/*
+** This following structure defines all the methods for the
+** typed_array virtual table.
+*/
+static sqlite3_module typedArrayModule = {
+  0,                         /* iVersion */
+  typedArrayConnect,         /* xCreate */
+  typedArrayConnect,         /* xConnect */
+  typedArrayBestIndex,       /* xBestIndex */
+  typedArrayDisconnect,      /* xDisconnect */
+  typedArrayDisconnect,      /* xDestroy */
+  typedArrayOpen,            /* xOpen - open a cursor */
+  typedArrayClose,           /* xClose - close a cursor */
+  typedArrayFilter,          /* xFilter - configure scan constraints */
+  typedArrayNext,            /* xNext - advance a cursor */
+  typedArrayEof,             /* xEof - check for end of scan */
+  typedArrayColumn,          /* xColumn - read data */
+  typedArrayRowid,           /* xRowid - read data */
+  0,                         /* xUpdate */
+  0,                         /* xBegin */
+  0,                         /* xSync */
+  0,                         /* xCommit */
+  0,                         /* xRollback */
+  0,                         /* xFindMethod */
+  0,                         /* xRename */
+  0,                         /* xSavepoint */
+  0,                         /* xRelease */
+  0,                         /* xRollbackTo */
+  0                          /* xShadowName */
+};
+
+#endif /* SQLITE_OMIT_VIRTUALTABLE */
+
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+int sqlite3_typedarray_init(
+  sqlite3 *db,
+  char **pzErrMsg,
+  const sqlite3_api_routines *pApi
+){
+  int rc = SQLITE_OK;
+  SQLITE_EXTENSION_INIT2(pApi);
+  (void)pzErrMsg;
+#ifndef SQLITE_OMIT_VIRTUALTABLE
+  rc = sqlite3_create_module(db, "typed_array", &typedArrayModule, 0);
+#endif
+  return rc;
+}
@@ -0,0 +1,262 @@
+/*
+** allocations.js is an allocation profiler meant for finding leaks. It
+** installs the allocator wrapper of src/wasm_malloc.c, which attributes
+** every allocation made by sqlite3 to an origin (see ORIGINS), tracks the
+** allocations Javascript makes with heap.malloc and the statements it
+** prepares, and takes snapshots of all of them that can be diffed, as in:
+**
+**   start(); // before the first connection is opened
+**   const before = snapshot();
+**   ... // work that should leave nothing behind
+**   console.log(diff(before, snapshot()));
+*/
+
+import * as _ from 'lodash';
+import Pointer from './pointer';
+import sqlite3, { memory, stack, heap } from './sqlite3'; // delibrate circular imports
+import { UTF8ToString } from './runtime';
+
+// origins allocations are attributed to, in the order of their tags; see src/wasm_malloc.c
+//   - other: connections and anything not attributed to another origin
+//   - pager: the page cache, which holds the pages of in-memory databases
+//   - schema: the schema, loaded ahead of statements being prepared
+//   - vdbe: statements being prepared and executed
+//   - fts5: statements using a fts5 table being prepared and executed
+//   - memdb: serialized and deserialized database images
+//   - js: allocations made by Javascript with heap.malloc or heap.sqlite3_malloc64
+export const ORIGINS = [ 'other', 'pager', 'schema', 'vdbe', 'fts5', 'memdb', 'js' ];
+export const OTHER = 0, PAGER = 1, SCHEMA = 2, VDBE = 3, FTS5 = 4, MEMDB = 5, JS = 6;
+
+// number of size classes, and size of a wasm_malloc_stat in bytes; see src/wasm_malloc.c
+const CLASSES = 32, STAT = 24 + CLASSES * 8;
+
+// lists the fts5 tables of a database, loading it's schema on the way
+const FTS5_TABLES = "SELECT name FROM sqlite_schema WHERE type = 'table' AND sql LIKE 'CREATE VIRTUAL TABLE%USING fts5%'";
+
+// reads the schema cookie, which changes with the schema; the fts5 tables are only listed again when it does
+const SCHEMA_VERSION = 'PRAGMA schema_version';
+
+// whether the profiler is started; it can't be stopped
+export let active = false;
+
+// counters of the allocations made with heap.malloc, which bypass sqlite3's allocator,
+// laid out as the ones of src/wasm_malloc.c; sizes maps live allocations to their size
+const js = { live: 0, total: 0, liveCount: 0, count: 0, aLive: new Array(CLASSES).fill(0), aCount: new Array(CLASSES).fill(0) };
+const sizes = new Map();
+
+// statements prepared since the profiler started and not finalized yet, by handle, and the
+// number of statements that were garbage collected without being finalized, by sql
+const statements = new Map();
+const leaked = new Map();
+const registry = typeof FinalizationRegistry !== 'undefined' ?
+  new FinalizationRegistry(({ handle, sql }) => {
+    statements.delete(handle);
+    leaked.set(sql, (leaked.get(sql) || 0) + 1);
+  }) : null;
+
+// sizeClass returns the size class of n: class i holds sizes in (2^(i-1), 2^i]
+const sizeClass = n => _.clamp(Math.ceil(Math.log2(Math.max(n, 1))), 0, CLASSES - 1);
+
+// Start installs the profiler. sqlite3's allocator can only be wrapped before the library is
+// initialized, so it must be called before the first connection is opened.
+export function start() {
+  if(active) return;
+  const rc = sqlite3.wasm_malloc_install();
+  if(rc === 21 /* SQLITE_MISUSE */) {
+    throw new Error('the allocation profiler must be started before the first connection is opened');
+  } else if(rc !== 0) {
+    throw new Error(sqlite3.sqlite3_errstr(rc));
+  }
+
+  // intercept the allocations Javascript makes
+  const { malloc, free, sqlite3_malloc64 } = heap;
+  heap.malloc = n => {
+    const ptr = malloc(n);
+    if(ptr !== 0) {
+      const i = sizeClass(n);
+      sizes.set(ptr, n);
+      js.live += n; js.total += n; js.liveCount += 1; js.count += 1; js.aLive[i] += 1; js.aCount[i] += 1;
+    }
+    return ptr;
+  };
+  heap.free = ptr => {
+    const n = sizes.get(ptr);
+    if(n !== undefined) {
+      sizes.delete(ptr);
+      js.live -= n; js.liveCount -= 1; js.aLive[sizeClass(n)] -= 1;
+    }
+    free(ptr);
+  };
+  heap.sqlite3_malloc64 = n => {
+    const prior = sqlite3.wasm_malloc_tag(JS);
+    if(prior !== OTHER) sqlite3.wasm_malloc_tag(prior); // the caller said whom it's for
+    const ptr = sqlite3_malloc64(n);
+    sqlite3.wasm_malloc_tag(prior);
+    return ptr;
+  };
+
+  active = true;
+}
+
+// Tag makes origin the origin of the allocations made by sqlite3 from now on and returns
+// the previous one, to be restored with tag again
+export function tag(origin) {
+  return sqlite3.wasm_malloc_tag(origin);
+}
+
+// schema loads the schema of connection, if it isn't yet, attributing it to SCHEMA, and
+// keeps a pattern matching the names of it's fts5 tables as connection.fts5. The pattern is
+// only built again once the schema version changed, read with a statement kept as
+// connection.schemaVersion until the connection is closed (see release).
+const schema = connection => {
+  const prior = tag(SCHEMA);
+  const esp = stack.save();
+  const names = [];
+  try {
+    const ptr = new Pointer(memory, stack.alloc(4));
+    if(connection.schemaVersion === undefined) {
+      if(sqlite3.sqlite3_prepare_v3(connection.handle, SCHEMA_VERSION, -1, 0x01 /* SQLITE_PREPARE_PERSISTENT */, ptr.p, 0) !== 0) return;
+      connection.schemaVersion = { handle: ptr.get(), version: null };
+    }
+
+    const cookie = connection.schemaVersion;
+    const version = sqlite3.sqlite3_step(cookie.handle) === 100 /* SQLITE_ROW */ ? sqlite3.sqlite3_column_int(cookie.handle, 0) : null;
+    sqlite3.sqlite3_reset(cookie.handle);
+    if(version !== null && version === cookie.version) return;
+    cookie.version = version;
+
+    if(sqlite3.sqlite3_prepare_v2(connection.handle, FTS5_TABLES, -1, ptr.p, 0) !== 0) return;
+    while(sqlite3.sqlite3_step(ptr.get()) === 100 /* SQLITE_ROW */) {
+      names.push(UTF8ToString(new Uint8Array(memory.buffer), sqlite3.sqlite3_column_text(ptr.get(), 0)));
+    }
+    sqlite3.sqlite3_finalize(ptr.get());
+    connection.fts5 = names.length > 0 ? new RegExp(`\\b(${names.map(_.escapeRegExp).join('|')})\\b`, 'i') : null;
+  } finally {
+    stack.restore(esp);
+    tag(prior);
+  }
+}
+
+// origin returns the origin of the allocations made by sql on connection
+const origin = (connection, sql) => (connection.fts5 && connection.fts5.test(sql) ? FTS5 : VDBE);
+
+// Enter loads the schema of connection, if required, and tags the allocations made from now
+// on as made by sql, which is about to be prepared or executed. It returns the previous origin,
+// to be restored with tag.
+export function enter(connection, sql) {
+  schema(connection);
+  return tag(origin(connection, sql));
+}
+
+// Release finalizes the statement schema keeps for connection, which is being closed
+export function release(connection) {
+  if(connection.schemaVersion !== undefined) {
+    sqlite3.sqlite3_finalize(connection.schemaVersion.handle);
+    connection.schemaVersion = undefined;
+  }
+}
+
+// Track starts tracking stmt, which was just prepared, until it's finalized
+export function track(stmt) {
+  const sql = sqlite3.sqlite3_sql(stmt.handle);
+  stmt.origin = origin(stmt.connection, sql);
+  statements.set(stmt.handle, sql);
+  if(registry) registry.register(stmt, { handle: stmt.handle, sql }, stmt);
+}
+
+// Untrack stops tracking stmt, which is being finalized
+export function untrack(stmt) {
+  if(stmt.origin === undefined) return;
+  statements.delete(stmt.handle);
+  if(registry) registry.unregister(stmt);
+}
+
+// counters returns the counters of an origin as reported by snapshot
+const counters = ({ live, total, liveCount, count, aLive, aCount }) => ({
+  live, liveCount, total, count,
+  histogram: _.range(CLASSES).filter(i => aCount[i] !== 0 || aLive[i] !== 0)
+    .map(i => ({ size: Math.pow(2, i), live: aLive[i], count: aCount[i] })),
+});
+
+// group returns [ sql, count ] pairs as an array of { sql, count }, largest first
+const group = pairs => _.orderBy(pairs.map(([ sql, count ]) => ({ sql, count })), 'count', 'desc');
+
+// Snapshot returns the allocations live now, by origin: live bytes and allocations (liveCount),
+// bytes and allocations ever made (total and count, resizes counting as allocations) and a histogram
+// of allocations by size class ({ size, live, count }, size being the upper bound of the class).
+// It also lists the statements not finalized yet and those that were garbage collected without being
+// finalized, by sql, along with how many of each.
+export function snapshot() {
+  if(!active) {
+    throw new Error('the allocation profiler is not started');
+  }
+
+  const origins = {};
+  const esp = stack.save();
+  try {
+    const ptr = stack.alloc(ORIGINS.length * STAT);
+    sqlite3.wasm_malloc_snapshot(ptr);
+    const view = new DataView(memory.buffer);
+    ORIGINS.forEach((name, i) => {
+      const p = ptr + i * STAT;
+      origins[name] = {
+        live: Number(view.getBigInt64(p, true)),
+        total: Number(view.getBigInt64(p + 8, true)),
+        liveCount: view.getInt32(p + 16, true),
+        count: view.getInt32(p + 20, true),
+        aLive: new Int32Array(memory.buffer, p + 24, CLASSES).slice(),
+        aCount: new Int32Array(memory.buffer, p + 24 + CLASSES * 4, CLASSES).slice(),
+      };
+    });
+  } finally {
+    stack.restore(esp);
+  }
+
+  // allocations made with heap.malloc add to the ones made with heap.sqlite3_malloc64
+  const own = origins.js;
+  origins.js = {
+    live: own.live + js.live, total: own.total + js.total, liveCount: own.liveCount + js.liveCount, count: own.count + js.count,
+    aLive: _.times(CLASSES, i => own.aLive[i] + js.aLive[i]), aCount: _.times(CLASSES, i => own.aCount[i] + js.aCount[i]),
+  };
+
+  return {
+    at: Date.now(),
+    live: _.sumBy(ORIGINS, name => origins[name].live),
+    origins: _.mapValues(origins, counters),
+    statements: { live: group(_.toPairs(_.countBy([ ...statements.values() ]))), leaked: group([ ...leaked ]) },
+  };
+}
+
+// delta returns b - a of two lists of { [key], count } entries, with the entries that didn't change left out
+const delta = (a, b, key, fields) => {
+  const before = _.keyBy(a, key);
+  const keys = _.uniq([ ...a.map(e => e[key]), ...b.map(e => e[key]) ]);
+  const after = _.keyBy(b, key);
+  return keys.map(k => {
+    const entry = { [key]: k };
+    fields.forEach(f => { entry[f] = _.get(after[k], f, 0) - _.get(before[k], f, 0) });
+    return entry;
+  }).filter(entry => fields.some(f => entry[f] !== 0));
+}
+
+// Diff returns what changed between two snapshots, before and after: for every origin, the change in
+// live bytes and allocations, the bytes and allocations made in between and the change in the histogram.
+// Statements lists the statements prepared in between that are still not finalized, and those that were
+// garbage collected without being finalized in between.
+export function diff(before, after) {
+  return {
+    elapsed: after.at - before.at,
+    live: after.live - before.live,
+    origins: _.mapValues(after.origins, (b, name) => {
+      const a = before.origins[name];
+      return {
+        live: b.live - a.live, liveCount: b.liveCount - a.liveCount, total: b.total - a.total, count: b.count - a.count,
+        histogram: _.sortBy(delta(a.histogram, b.histogram, 'size', [ 'live', 'count' ]), 'size'),
+      };
+    }),
+    statements: {
+      live: delta(before.statements.live, after.statements.live, 'sql', [ 'count' ]).filter(e => e.count > 0),
+      leaked: delta(before.statements.leaked, after.statements.leaked, 'sql', [ 'count' ]),
+    },
+  };
+}
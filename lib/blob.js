@@ -0,0 +1,36 @@
+import { memory } from './sqlite3';
+
+/*
+** BlobView is a zero-copy view over a blob value in the current row of a statement.
+** The memory is owned by sqlite3 and remains valid only until the statement is stepped,
+** reset or finalized; reading the view after that throws instead of returning garbage.
+*/
+export default class BlobView {
+
+  // create a new view over size bytes at ptr for the current row of stmt
+  constructor(stmt, ptr, size) {
+    this.stmt = stmt;
+    this.generation = stmt.generation;
+    this.ptr = ptr;
+    this.byteLength = size;
+  }
+
+  // Valid reports whether the view still points to the row it was created for
+  get valid() {
+    return this.generation === this.stmt.generation;
+  }
+
+  // Bytes returns a Uint8Array directly over the blob's memory. The array must not be held
+  // on to beyond the current row; it's also detached if the wasm memory grows in between.
+  get bytes() {
+    if(!this.valid) {
+      throw new Error('stale blob view: statement has moved past the row it was read from');
+    }
+    return new Uint8Array(memory.buffer, this.ptr, this.byteLength);
+  }
+
+  // Copy returns a copy of the blob that remains valid indefinitely
+  copy() {
+    return this.bytes.slice();
+  }
+}
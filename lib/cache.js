@@ -0,0 +1,116 @@
+import sqlite3 from './sqlite3';
+
+/*
+** StatementCache is a bounded, least-recently-used cache of prepared statements
+** keyed by their sql text. Statements are compiled with SQLITE_PREPARE_PERSISTENT
+** as they are expected to be reused many times over. It's owned by a Connection
+** and is available as connection.cache
+**
+** Statements are reset on every checkout, except those being run by code that's
+** still on the stack (stmt.depth > 0): a step calling into a function, an
+** executeMany, a Statement#slices left suspended or a Connection#withCached.
+** Asking for the same sql from there gets a fresh statement of it's own, and
+** such statements evicted from the cache aren't finalized either. Both kinds
+** are kept as orphans, at most maxOrphans of them; past that, the oldest ones
+** no longer running are finalized.
+*/
+const maxOrphans = 16;
+
+export default class StatementCache {
+
+  // create a new cache that holds at most capacity statements
+  constructor(connection, capacity) {
+    this.connection = connection;
+    this.capacity = capacity;
+    this.entries = new Map(); // a Map iterates in insertion order, so it's first key is the least recently used one
+    this.orphans = new Set(); // statements handed out that aren't (or no longer) cached, oldest first
+
+    // counters for cache effectiveness
+    this.hits = 0;
+    this.misses = 0;
+    this.evictions = 0;
+  }
+
+  // Get returns a ready-to-use statement for the query, compiling it on a miss.
+  // The statement is reset and it's bindings are cleared before it's handed out.
+  // Returned statement is owned by the cache and must not be finalized by the caller.
+  get(query) {
+    let stmt = this.entries.get(query);
+    if(stmt !== undefined && stmt.handle !== 0 && stmt.depth > 0) {
+      // it's running further up the stack, so leave it be and hand out a statement of it's own
+      this.misses += 1;
+      stmt = this.connection.prepare(query);
+      this.adopt(stmt);
+      return stmt;
+    }
+    if(stmt !== undefined) {
+      this.entries.delete(query);
+      if(stmt.handle !== 0) { // skip over statements finalized behind our back
+        this.hits += 1;
+        
+        // sqlite3_reset returns the error (if any) from the previous execution, 
+        // which has already been reported to whoever ran it; so we ignore it here
+        stmt._record();
+        stmt.generation += 1;
+        sqlite3.sqlite3_reset(stmt.handle);
+        sqlite3.sqlite3_clear_bindings(stmt.handle);
+
+        this.entries.set(query, stmt); // re-insert to mark it most recently used
+        return stmt;
+      }
+    }
+
+    this.misses += 1;
+    stmt = this.connection.prepare(query, 0x01 /* SQLITE_PREPARE_PERSISTENT */);
+    this.entries.set(query, stmt);
+    this.trim();
+    return stmt;
+  }
+
+  // Resize changes the capacity of the cache, evicting statements if needed
+  resize(capacity) {
+    this.capacity = capacity;
+    this.trim();
+  }
+
+  // Clear finalizes and removes all statements from the cache, orphans included,
+  // as the connection is being closed
+  clear() {
+    this.entries.forEach(stmt => { if(stmt.handle !== 0) stmt.finalize() });
+    this.entries.clear();
+    this.orphans.forEach(stmt => { if(stmt.handle !== 0) stmt.finalize() });
+    this.orphans.clear();
+  }
+
+  // Stats returns the cache counters
+  stats() {
+    return { 
+      size: this.entries.size, capacity: this.capacity, orphans: this.orphans.size,
+      hits: this.hits, misses: this.misses, evictions: this.evictions 
+    };
+  }
+
+  // trim evicts least recently used statements until the cache is within it's capacity
+  trim() {
+    for(const [query, stmt] of this.entries) {
+      if(this.entries.size <= this.capacity) break;
+      
+      this.entries.delete(query);
+      this.evictions += 1;
+      if(stmt.depth > 0) this.adopt(stmt); // it's running further up the stack
+      else if(stmt.handle !== 0) stmt.finalize();
+    }
+  }
+
+  // adopt keeps stmt as an orphan, finalizing the oldest orphans no longer running
+  // once there are more than maxOrphans of them
+  adopt(stmt) {
+    this.orphans.add(stmt);
+    for(const orphan of this.orphans) {
+      if(this.orphans.size <= maxOrphans) break;
+      if(orphan.depth > 0 && orphan.handle !== 0) continue;
+      this.orphans.delete(orphan);
+      if(orphan.handle !== 0) orphan.finalize();
+    }
+  }
+}
@@ -0,0 +1,79 @@
+/*
+** changes.js delivers the rows changed by committed transactions (see
+** Connection#changes) and provides the environment import src/wasm_hooks.c
+** calls into with the changes of every transaction.
+*/
+
+import * as _ from 'lodash';
+import { memory } from './sqlite3'; // delibrate circular imports
+import { UTF8ToString } from './runtime';
+
+// change operations; the values of SQLITE_INSERT, SQLITE_UPDATE and SQLITE_DELETE
+export const INSERT = 18, UPDATE = 23, DELETE = 9;
+
+// listeners, keyed by the id handed over to wasm_changes_open
+const listeners = new Map();
+let nextListener = 1;
+
+// Register adds the listener fn and returns the id that identifies it to C. Rowids are
+// delivered as BigInt when int64 is set, and as doubles otherwise.
+export function register(fn, int64 = false) {
+  const id = nextListener++;
+  listeners.set(id, { fn, int64 });
+  return id;
+}
+
+// Unregister removes the listener id
+export function unregister(id) {
+  listeners.delete(id);
+}
+
+/*
+** Changes are the rows changed by a single transaction, in the order they were changed.
+** ops, tables and rowids are parallel typed arrays: the i-th change is ops[i] (INSERT, UPDATE or
+** DELETE) of the row rowids[i] of the table names[tables[i]].
+*/
+export class Changes {
+  constructor(ops, tables, rowids, names, dropped, complete) {
+    this.length = ops.length;
+    this.ops = ops;
+    this.tables = tables;
+    this.rowids = rowids;
+    this.names = names;       // tables changed, as [schema.]table
+    this.dropped = dropped;   // table name -> number of changes that didn't fit in the buffer
+    this.complete = complete; // false if any change was dropped; the tables in dropped may have changed anywhere
+  }
+
+  // iterate over the changes as { op, table, rowid } objects
+  *[Symbol.iterator]() {
+    for(let i = 0; i < this.length; i++) {
+      yield { op: this.ops[i], table: this.names[this.tables[i]], rowid: this.rowids[i] };
+    }
+  }
+}
+
+// wasm_changes_commit provides implementation of
+// C extern function with similar name defined in src/os_wasm.h
+// It copies the changes out of the wasm_changes at ptr (see src/wasm_hooks.c for the layout) and delivers
+// them to the listener in a microtask, once the commit is done, so that listeners can use the connection
+// and their errors don't unwind through sqlite3.
+export function wasm_changes_commit(id, ptr) {
+  const listener = listeners.get(id);
+  if(listener === undefined) return;
+
+  const [ nEntry, /* nAlloc */, /* nCapacity */, nTable, aOp, aTable, aRowid, azTable, anDropped, bDropped ] = new Int32Array(memory.buffer, ptr, 10);
+  const heap = new Uint8Array(memory.buffer);
+
+  const ops = new Int32Array(memory.buffer, aOp, nEntry).slice();
+  const tables = new Int32Array(memory.buffer, aTable, nEntry).slice();
+  const raw = new BigInt64Array(memory.buffer, aRowid, nEntry);
+  const rowids = listener.int64 ? raw.slice() : Float64Array.from(raw, Number);
+
+  const names = Array.from(new Int32Array(memory.buffer, azTable, nTable), z => UTF8ToString(heap, z));
+  const counts = new Int32Array(memory.buffer, anDropped, nTable);
+  const dropped = _.pickBy(_.zipObject(names, Array.from(counts)), n => n > 0);
+  const complete = bDropped === 0 && _.isEmpty(dropped);
+
+  const changes = new Changes(ops, tables, rowids, names, dropped, complete);
+  queueMicrotask(() => listener.fn(changes));
+}
@@ -0,0 +1,38 @@
+/*
+** column.js provides readers for individual columns of a statement's current row.
+** They read a column as a given type, without checking the column's type first.
+*/
+
+import sqlite3 from './sqlite3';
+import { HEAPU8, UTF8Decode, UTF16Decode } from './runtime';
+
+// column_int64 reads an integer column at pos exactly. Values that fit in a safe integer take the fast path
+// through sqlite3_column_double and are returned as plain numbers, unless mode is 'bigint'
+// in which case every value is returned as a BigInt.
+export const column_int64 = function(stmt, pos, mode) {
+  if(mode !== 'bigint') {
+    let val = sqlite3.sqlite3_column_double(stmt, pos);
+    if(Number.isSafeInteger(val)) {
+      return val;
+    }
+  }
+  return sqlite3.sqlite3_column_int64(stmt, pos);
+}
+
+// column_text reads a text column at pos using it's exact length in bytes, decoding it through strings
+// (an InternTable) when one is provided. It returns null for NULL values.
+export const column_text = function(stmt, pos, strings) {
+  let ptr = sqlite3.sqlite3_column_text(stmt, pos);
+  if(ptr === 0) return null;
+  let length = sqlite3.sqlite3_column_bytes(stmt, pos);
+  return strings? strings.decode(HEAPU8(), ptr, length) : UTF8Decode(HEAPU8(), ptr, length);
+}
+
+// column_text16 is like column_text but fetches the column as UTF-16, which needs no transcoding for UTF-16 databases.
+// sqlite3_column_bytes16 must be called after sqlite3_column_text16 for the pointer to remain valid.
+export const column_text16 = function(stmt, pos, strings) {
+  let ptr = sqlite3.sqlite3_column_text16(stmt, pos);
+  if(ptr === 0) return null;
+  let length = sqlite3.sqlite3_column_bytes16(stmt, pos);
+  return strings? strings.decode(HEAPU8(), ptr, length) : UTF16Decode(HEAPU8(), ptr, length);
+}
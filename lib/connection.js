@@ -1,6 +1,25 @@
+import * as _ from 'lodash';
 import Pointer from './pointer';
-import sqlite3, { memory, stack } from './sqlite3';
+import sqlite3, { memory, stack, heap } from './sqlite3';
 import Statement from './statement';
+import StatementCache from './cache';
+import Statistics, { now } from './statistics';
+import TypedArrayTable from './typed_array';
+import { lengthBytesUTF8, stringToUTF8, UTF8ToString } from './runtime';
+import { measure, pack, NULL } from './packer';
+import { register } from './functions';
+import { register as registerModule } from './vtab';
+import * as changes from './changes';
+import { connectionStats } from './stats';
+import * as allocations from './allocations';
+import * as trace from './trace';
+import { watch, settle, unwatch } from './progress';
+
+// eTextRep flags of sqlite3_create_function_v2
+const SQLITE_UTF8 = 1, SQLITE_DETERMINISTIC = 0x800;
+
+// matches the text sqlite3_prepare leaves in the tail when there's no further statement to compile
+const BLANK = /^(\s|;|--[^\n]*(\n|$)|\/\*([^*]|\*(?!\/))*(\*\/|$))*$/;
 
 /*
 ** Connection represents an individual database connection.
@@ -8,8 +27,31 @@ import Statement from './statement';
 */
 export default class Connection {
   
-  // open a new database connection
-  constructor(uri, flags, vfs) {
+  // open a new database connection. options are inherited by every statement
+  // prepared on this connection (see Statement#configure) and can contain:
+  //   - int64: false to read integers as doubles (default), true to read them exactly
+  //            (as numbers when they fit in a safe integer, as BigInt otherwise) or
+  //            'bigint' to always read them as BigInt
+  //   - cacheSize: maximum number of statements kept by the statement cache (default 64)
+  //   - intern: true, or { capacity, maxLength }, to intern short text values so that repeated values
+  //             share a single string instead of being decoded again for every row (default false)
+  //   - text: 'utf8' (default) or 'utf16' to bind and fetch text as UTF-16, copying the code units of
+  //           Javascript strings as is. Text in UTF-16 databases then needs no transcoding at all.
+  //   - blobs: 'copy' (default) to copy blobs out of wasm memory or 'view' to return a BlobView directly
+  //            over sqlite3's memory, which is only valid until the statement is stepped again
+  //   - statistics: true, or { slowThreshold, slowLogSize }, to accumulate the executions of statements per
+  //                 query shape in connection.statistics (see lib/statistics.js) (default false)
+  //   - progressInterval: number of virtual machine instructions between checks for cancellation, once
+  //                       cancelOn, timeout or Statement#slices is used (default 1000)
+  constructor(uri, flags, vfs, options = {}) {
+    this.options = _.defaults({}, options, { int64: false, cacheSize: 64, intern: false, text: 'utf8', blobs: 'copy', statistics: false, progressInterval: 1000 });
+    this.cache = new StatementCache(this, this.options.cacheSize);
+    this.statistics = this.options.statistics ? new Statistics(this, _.isObject(this.options.statistics) ? this.options.statistics : {}) : null;
+    this.scratchPtr = 0;
+    this.scratchSize = 0;
+    this.listener = 0; // id of the change listener, if any
+    this.zombie = null; // once closed, the statements not finalized yet that keep it open, by handle
+
     let esp = stack.save();
     let ptr = new Pointer(memory, stack.alloc(4));
     let rc = sqlite3.sqlite3_open_v2(uri, ptr.p, flags, vfs);
@@ -23,19 +65,36 @@ export default class Connection {
 
     this.handle = ptr.get(); // save the reference to the database
     stack.restore(esp);
+    Connection.open += 1;
+    if(trace.active) trace.connect(this);
   }
 
   // Prepare prepares / compiles the provided query returning the
-  // resulting statement object.
-  prepare(query) {
+  // resulting statement object. flags are passed on to sqlite3_prepare_v3 as prepFlags.
+  // The caller owns the returned statement and must finalize it. Use Connection#exec to run
+  // sql containing more than one statement.
+  prepare(query, flags = 0) {
     let esp = stack.save();
     let ptr = new Pointer(memory, stack.alloc(4));
     let tail = new Pointer(memory, stack.alloc(4));
-    let rc = sqlite3.sqlite3_prepare_v2(this.handle, query, -1 /* read in until nullptr */, ptr.p, tail.p);
+
+    // marshal the query ourselves so that the tail can be inspected once sqlite3 is done with it
+    let len = lengthBytesUTF8(query) + 1;
+    let sql = stack.alloc(len);
+    stringToUTF8(query, new Uint8Array(memory.buffer), sql, len);
+
+    const prior = allocations.active ? allocations.enter(this, query) : -1;
+    const start = trace.active ? now() : -1;
+    let rc = sqlite3.sqlite3_prepare_v3(this.handle, sql, len, flags, ptr.p, tail.p);
+    if(start >= 0) trace.span('prepare', start, { sql: query });
+    if(prior >= 0) allocations.tag(prior);
     if(rc !== 0) { // !== SQLITE_OK
-      throw new Error(sqlite3.sqlite3_errstr(rc));
-    } else if (tail.get() !== 0) {
-      // throw new Error('multiple statements not supported');
+      stack.restore(esp);
+      throw new Error(sqlite3.sqlite3_errmsg(this.handle));
+    } else if (!BLANK.test(UTF8ToString(new Uint8Array(memory.buffer), tail.get()))) {
+      sqlite3.sqlite3_finalize(ptr.get());
+      stack.restore(esp);
+      throw new Error('multiple statements not supported; use exec() instead');
     }
     
     let stmt = new Statement(this, ptr.get());
@@ -43,16 +102,290 @@ export default class Connection {
     return stmt;
   }
 
+  // Exec runs all the statements in sql, one after the other, stopping at the first error.
+  // The script is copied into wasm memory only once. Unless options.collect is set, the whole
+  // script runs inside sqlite3_exec in a single call; else each statement is compiled off the 
+  // tail of the previous one and an array of { columns, rows } is returned, with an entry for 
+  // every statement that returns a resultset.
+  exec(sql, options = {}) {
+    let len = lengthBytesUTF8(sql) + 1;
+    let ptr = heap.malloc(len);
+    stringToUTF8(sql, new Uint8Array(memory.buffer), ptr, len);
+
+    try {
+      if(!options.collect) {
+        const prior = allocations.active ? allocations.enter(this, sql) : -1;
+        let rc = sqlite3.sqlite3_exec(this.handle, ptr, 0, 0, 0);
+        if(prior >= 0) allocations.tag(prior);
+        if(rc !== 0) { // !== SQLITE_OK
+          throw new Error(sqlite3.sqlite3_errmsg(this.handle));
+        }
+        return;
+      }
+
+      let results = [];
+      let esp = stack.save();
+      let stmt = new Pointer(memory, stack.alloc(4));
+      let tail = new Pointer(memory, stack.alloc(4));
+      
+      try {
+        for(let cur = ptr, end = ptr + len - 1; cur < end; cur = tail.get()) {
+          const prior = allocations.active ? allocations.enter(this, UTF8ToString(new Uint8Array(memory.buffer), cur)) : -1;
+          let rc = sqlite3.sqlite3_prepare_v3(this.handle, cur, end - cur + 1 /* include the nul-terminator */, 0, stmt.p, tail.p);
+          if(prior >= 0) allocations.tag(prior);
+          if(rc !== 0) { // !== SQLITE_OK
+            throw new Error(sqlite3.sqlite3_errmsg(this.handle));
+          } else if(stmt.get() === 0) { 
+            continue; // it was only whitespace or a comment
+          }
+          
+          let s = new Statement(this, stmt.get());
+          try {
+            let columns = s.columns(), rows = [];
+            while(s.step()) { rows.push(s.get()) }
+            if(columns.length > 0) {
+              results.push({ columns, rows });
+            }
+          } finally {
+            allocations.untrack(s);
+            sqlite3.sqlite3_finalize(s.handle); // any error has already been reported by step()
+          }
+        }
+      } finally {
+        stack.restore(esp);
+      }
+
+      return results;
+    } finally {
+      heap.free(ptr);
+    }
+  }
+
+  // ExecuteMany executes sql once for every parameter set in rows (arrays for positional
+  // parameters, objects for named ones) inside a single savepoint, and returns the number of rows
+  // changed. Parameter sets are packed into wasm memory and executed by a loop in C, options.batchSize
+  // (default 4096) rows at a time, so there's a single call into wasm per batch. Parameters missing 
+  // from a parameter set are bound to NULL. Any rows returned by the statement are discarded.
+  executeMany(sql, rows, options = {}) {
+    const { batchSize = 4096 } = options;
+    const stmt = this.cached(sql);
+    const layout = stmt.parameters();
+    const nParam = stmt.nParam;
+    const utf16 = stmt.options.text === 'utf16';
+    const before = sqlite3.sqlite3_total_changes(this.handle);
+
+    this.exec('SAVEPOINT execute_many');
+    if(this.listener) { // ROLLBACK TO doesn't fire the rollback hook
+      const rc = sqlite3.wasm_changes_savepoint(this.handle);
+      if(rc !== 0) { // without the mark, a failed batch would be reported at commit
+        this.exec('RELEASE execute_many');
+        throw new Error(sqlite3.sqlite3_errstr(rc));
+      }
+    }
+    let esp = stack.save();
+    let done = new Pointer(memory, stack.alloc(4));
+    stmt.depth += 1; // functions called by the batch mustn't get it from the cache
+    try {
+      for(let offset = 0; offset < rows.length; offset += batchSize) {
+        let batch = rows.slice(offset, offset + batchSize);
+        let ptr = heap.malloc(Math.max(measure(batch, nParam, layout, utf16), 1));
+        try {
+          pack(ptr, batch, nParam, layout, { missing: NULL, utf16 });
+          let start = this.statistics ? now() : 0;
+          let rc = sqlite3.wasm_execute_many(stmt.handle, ptr, batch.length, nParam, done.p);
+          if(this.statistics) {
+            this.statistics.record(stmt, now() - start, 0, rc !== 0 ? done.get() + 1 : batch.length, rc !== 0);
+          }
+          if(rc !== 0) { // !== SQLITE_OK
+            throw new Error(`${sqlite3.sqlite3_errmsg(this.handle)} (row ${offset + done.get()})`);
+          }
+        } finally {
+          heap.free(ptr);
+        }
+      }
+    } catch(e) {
+      this.exec('ROLLBACK TO execute_many');
+      if(this.listener) sqlite3.wasm_changes_rollback_to(this.handle); // before RELEASE commits them
+      this.exec('RELEASE execute_many');
+      if(this.listener) sqlite3.wasm_changes_release(this.handle);
+      throw e;
+    } finally {
+      stack.restore(esp);
+      stmt.depth -= 1;
+    }
+
+    this.exec('RELEASE execute_many');
+    if(this.listener) sqlite3.wasm_changes_release(this.handle);
+    return sqlite3.sqlite3_total_changes(this.handle) - before;
+  }
+
+  // Function registers fn as the scalar sql function name, taking options.nArg arguments (defaults to
+  // fn.length; -1 for any number of them). fn is called once per row with the arguments as Javascript values
+  // (see Statement#column) and may return a number, bigint, boolean, string, Uint8Array / ArrayBuffer or null.
+  // Errors thrown by fn are reported as sql errors. Set options.deterministic to let sqlite3 factor out calls.
+  function(name, fn, options = {}) {
+    const { nArg = fn.length, deterministic = false } = options;
+    this._createFunction(name, nArg, deterministic, { fn }, 0);
+  }
+
+  // Aggregate registers the aggregate sql function name from impl = { init, step, final }. Rows are buffered
+  // in wasm memory and handed over options.batchSize (default 1024) at a time to step(state, batch), which
+  // returns the new state (or undefined to keep it). batch.length is the number of rows and batch.columns[j]
+  // holds argument j of every row: columns[j].types (sqlite3 datatypes) and columns[j].values (INTEGER and FLOAT
+  // values, as doubles) are typed arrays over wasm memory that are only valid during the call, and 
+  // columns[j].value(i) returns a single value. init() creates the state and final(state) returns the result.
+  // options.nArg is required (-1 for any number of arguments); options.deterministic is as in Connection#function.
+  aggregate(name, impl, options = {}) {
+    const { nArg, deterministic = false, batchSize = 1024 } = options;
+    if(!Number.isInteger(nArg)) {
+      throw new TypeError('options.nArg is required');
+    }
+    this._createFunction(name, nArg, deterministic, impl, Math.max(batchSize | 0, 1));
+  }
+
+  // Module registers impl as the virtual table module name, backed by Javascript. Tables are created with
+  // CREATE VIRTUAL TABLE ... USING name(args), or used directly as eponymous tables. impl contains:
+  //   - schema: the CREATE TABLE statement declaring the columns, or a function returning it given the module args
+  //   - rows: an array or iterable of rows, each an array of column values in schema order; or a function called 
+  //           with the constraints pushed down by sqlite3 ([{ column, op, value }]) for every scan, returning one.
+  //           Iterables (a Set, say) are iterated again on every scan, so they're live; one-shot iterators 
+  //           (a generator, map.values()) are read into an array once, when the module is registered
+  //   - bestIndex(info), filter(args, idxNum, idxStr): replace rows to take over planning completely (see lib/vtab.js)
+  // Rows reach sqlite3 options.batchSize (default 256) at a time. With rows, comparisons on columns are pushed down 
+  // and rows that can't match are dropped before they are packed.
+  module(name, impl, options = {}) {
+    const { batchSize = 256 } = options;
+    const rc = sqlite3.wasm_create_module(this.handle, name, registerModule(impl), Math.max(batchSize | 0, 1));
+    if(rc !== 0) { // !== SQLITE_OK
+      throw new Error(sqlite3.sqlite3_errmsg(this.handle));
+    }
+  }
+
+  // TypedArray exposes columns (an object of column name -> array) as the read-only virtual table temp.name,
+  // whose rowids are the indexes of the values plus one. Columns backed by wasm memory (Float64Array, Int32Array
+  // or BigInt64Array views over memory.buffer) are read in place and must stay valid until the table is released.
+  // Returns a TypedArrayTable; call release() on it once done. Names are shared by all connections.
+  typedArray(name, columns) {
+    return new TypedArrayTable(this, name, columns);
+  }
+
+  // Changes calls callback with the rows changed by every transaction that commits, as a single Changes
+  // object per transaction (see lib/changes.js), and returns a function that stops the feed. Changes are
+  // buffered in C, up to options.capacity (default 65536) per transaction, and handed over once at commit;
+  // changes past the capacity are only counted per table. Changes rolled back are discarded, as are those of a
+  // failed executeMany, but not those undone by a ROLLBACK TO of the caller's, which has no hook. Like the
+  // update hook it builds on, the feed misses changes to WITHOUT ROWID tables, the truncate optimization
+  // (DELETE without a WHERE clause) and the rows deleted by ON CONFLICT REPLACE (or INSERT OR REPLACE) to make
+  // room for the new ones. A connection has a single feed; calling changes again replaces it.
+  changes(callback, options = {}) {
+    const { capacity = 65536 } = options;
+    const id = changes.register(callback, this.options.int64 !== false);
+    const rc = sqlite3.wasm_changes_open(this.handle, id, capacity);
+    if(rc !== 0) { // !== SQLITE_OK
+      changes.unregister(id);
+      throw new Error(sqlite3.sqlite3_errstr(rc));
+    }
+
+    if(this.listener) changes.unregister(this.listener);
+    this.listener = id;
+    return () => {
+      if(this.listener === id) {
+        sqlite3.wasm_changes_close(this.handle);
+        this.listener = 0;
+      }
+      changes.unregister(id);
+    };
+  }
+
+  // CancelOn interrupts any statement running on the connection while flag[index] isn't 0. flag is an Int32Array,
+  // usually over a SharedArrayBuffer so that another thread can set it while a statement runs; it's checked every
+  // progressInterval instructions (see Connection#constructor). Interrupted statements throw 'interrupted'. The flag
+  // is never cleared by the connection; pass null to stop checking it.
+  cancelOn(flag, index = 0) {
+    const state = watch(this);
+    state.flag = flag;
+    state.index = index;
+    settle(this);
+  }
+
+  // Timeout interrupts the statement running on the connection ms milliseconds from now, if any. The timeout
+  // is cleared once it fired, or with timeout(0). Like cancelOn, it's checked every progressInterval instructions.
+  timeout(ms) {
+    watch(this).deadline = ms > 0 ? now() + ms : Infinity;
+    settle(this);
+  }
+
+  // Interrupt interrupts the statements running on the connection, as from a function or virtual table
+  // called by one of them, or the ones suspended in Statement#slices
+  interrupt() {
+    sqlite3.sqlite3_interrupt(this.handle);
+  }
+
+  // _createFunction registers impl with the function registry and creates the sql function using it
+  _createFunction(name, nArg, deterministic, impl, batchSize) {
+    const flags = SQLITE_UTF8 | (deterministic ? SQLITE_DETERMINISTIC : 0);
+    const rc = sqlite3.wasm_create_function(this.handle, name, nArg, flags, register(impl), batchSize);
+    if(rc !== 0) { // !== SQLITE_OK
+      throw new Error(sqlite3.sqlite3_errmsg(this.handle));
+    }
+  }
+
+  // Cached returns a prepared statement for query from the connection's statement cache,
+  // compiling it only the first time around. The statement comes back reset with no bindings 
+  // and stays owned by the cache, so the caller must not finalize it. The next cached() of the same
+  // query resets it, unless it's running further up the stack (a function called by it's step, say),
+  // in which case another statement is compiled; use withCached to hold on to it for longer.
+  cached(query) {
+    return this.cache.get(query);
+  }
+
+  // WithCached calls fn with a statement for query from the statement cache and returns what fn
+  // returns. The statement is held until fn returns, so cached() of the same query from inside fn
+  // compiles another statement instead of resetting it, and it's reset once fn returns.
+  withCached(query, fn) {
+    const stmt = this.cache.get(query);
+    stmt.depth += 1;
+    try {
+      return fn(stmt);
+    } finally {
+      stmt.depth -= 1;
+      if(stmt.handle !== 0) { // the error (if any) was reported by the step that failed
+        stmt._record();
+        stmt.generation += 1;
+        sqlite3.sqlite3_reset(stmt.handle);
+      }
+    }
+  }
+
+  // Scratch returns a pointer to a heap region of at least size bytes that's reused across calls,
+  // growing it when required. The region is only valid until the next call to scratch.
+  scratch(size) {
+    if(size > this.scratchSize) {
+      if(this.scratchPtr) heap.free(this.scratchPtr);
+      this.scratchSize = Math.max(size, this.scratchSize * 2);
+      this.scratchPtr = heap.malloc(this.scratchSize);
+    }
+    return this.scratchPtr;
+  }
+
+  // Stats returns the connection's memory statistics (see lib/stats.js); reset resets the counters
+  stats(reset = false) {
+    return connectionStats(this, reset);
+  }
+
   // Serialize serilizes the database using sqlite3_serialize interface
   // and returns an ArrayBuffer containing the serialized view of the database
   serialize() {
     let esp = stack.save();
 
     let size = new Pointer(memory, stack.alloc(8)); // to hold the size of the buffer
+    const prior = allocations.active ? allocations.tag(allocations.MEMDB) : -1;
     const ptr = sqlite3.sqlite3_serialize(this.handle, "main", size.p, 0);
+    if(prior >= 0) allocations.tag(prior);
     if(ptr === 0) {
       // it's likely that sqlite3_serialize failed to allocate memory
       const message = sqlite3.sqlite3_errmsg(this.handle);
+      stack.restore(esp);
       throw new Error(message);
     }
 
@@ -60,8 +393,50 @@ export default class Connection {
     let buf = new Uint8Array(out);
     let mem = new Uint8Array(memory.buffer, ptr, size.get());
     buf.set(mem); // copy from memory into output buffer
+    heap.sqlite3_free(ptr); // the copy sqlite3_serialize made is ours to free
 
     stack.restore(esp);
     return out;
   }
+
+  // Close finalizes all statements held by the statement cache and closes the connection.
+  // Statements prepared with Connection#prepare must be finalized by the caller; sqlite3 
+  // defers closing the connection until they are, and it's counted as open until then.
+  close() {
+    this.cache.clear();
+    if(this.listener) {
+      sqlite3.wasm_changes_close(this.handle);
+      changes.unregister(this.listener);
+      this.listener = 0;
+    }
+    if(this.scratchPtr) {
+      heap.free(this.scratchPtr);
+      this.scratchPtr = 0;
+      this.scratchSize = 0;
+    }
+
+    unwatch(this);
+    allocations.release(this);
+    const live = new Set(); // sqlite3 keeps the connection open, as a zombie, until they are finalized
+    for(let s = sqlite3.sqlite3_next_stmt(this.handle, 0); s !== 0; s = sqlite3.sqlite3_next_stmt(this.handle, s)) live.add(s);
+    let rc = sqlite3.sqlite3_close_v2(this.handle);
+    if(rc !== 0) { // the connection is still open, and still ours
+      throw new Error(sqlite3.sqlite3_errstr(rc));
+    }
+    if(live.size > 0) this.zombie = live; else Connection.open -= 1;
+    this.handle = 0;
+  }
+
+  // _reap is called by Statement#finalize on the statements of a zombie connection, and counts it as closed
+  // once the statement handle, being finalized, was the last one keeping it open
+  _reap(handle) {
+    this.zombie.delete(handle);
+    if(this.zombie.size === 0) {
+      this.zombie = null;
+      Connection.open -= 1;
+    }
+  }
 }
+
+// number of connections open, including zombies
+Connection.open = 0;
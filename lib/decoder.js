@@ -0,0 +1,98 @@
+/*
+** decoder.js compiles row decoders specialised for a statement's resultset (see Statement#object).
+** A decoder builds every row with the same object literal, so all rows share a single 
+** hidden class, and reads every column with the reader picked for it's declared type.
+** The datatypes of the whole row are fetched in a single call, and readers only check
+** the value is of the type they expect instead of switching on it.
+*/
+
+import sqlite3 from './sqlite3';
+import { HEAPU8 } from './runtime';
+import { column_text, column_text16 } from './column';
+
+// factories caches compiled decoder factories by resultset shape, so statements
+// with the same columns and declared types share the same generated code
+const factories = new Map();
+
+// affinity returns the kind of reader to use for a column with the given declared type,
+// following sqlite3's rules for determining column affinity (https://www.sqlite.org/datatype3.html)
+const affinity = decltype => {
+  if(!decltype) return 'column'; // expressions have no declared type
+  const t = decltype.toUpperCase();
+  if(t.includes('INT')) return 'integer';
+  if(t.includes('CHAR') || t.includes('CLOB') || t.includes('TEXT')) return 'text';
+  if(t.includes('BLOB')) return 'column'; // columns with BLOB affinity can hold any type of value
+  if(t.includes('REAL') || t.includes('FLOA') || t.includes('DOUB')) return 'real';
+  return 'column'; // NUMERIC affinity holds both integers and reals
+}
+
+// value reads the column at pos, of the given datatype, as Statement#column does
+const value = (stmt, pos, type) => {
+  switch(type) {
+    case 1: /* SQLITE_INTEGER */ return stmt.integer(pos);
+    case 2: /* SQLITE_FLOAT */ return stmt.real(pos);
+    case 3: /* SQLITE_TEXT */ return stmt.text(pos);
+    case 4: /* SQLITE_BLOB */ return stmt.blob(pos);
+    default: /* SQLITE_NULL */ return null;
+  }
+}
+
+// readers creates the reader for a column of the given kind, called with the column's position and the
+// datatype of it's value (read for the whole row at once by wasm_column_types). Readers read values of the
+// type they expect directly, leaving anything else (NULLs, and values that don't match the column's affinity,
+// as text in an INTEGER column or a blob in a TEXT column of a non-STRICT table) to value, so that rows read
+// the same as with Statement#get.
+const readers = {
+  integer: stmt => {
+    if(stmt.options.int64) {
+      return (pos, type) => type === 1 /* SQLITE_INTEGER */ ? stmt.integer(pos) : value(stmt, pos, type);
+    }
+    return (pos, type) => type === 1 /* SQLITE_INTEGER */ ? sqlite3.sqlite3_column_double(stmt.handle, pos) : value(stmt, pos, type);
+  },
+  real: stmt => (pos, type) => type === 2 /* SQLITE_FLOAT */ ? sqlite3.sqlite3_column_double(stmt.handle, pos) : value(stmt, pos, type),
+  text: stmt => {
+    const read = stmt.options.text === 'utf16'? column_text16 : column_text;
+    return (pos, type) => type === 3 /* SQLITE_TEXT */ ? read(stmt.handle, pos, stmt.strings()) : value(stmt, pos, type);
+  },
+  column: stmt => (pos, type) => value(stmt, pos, type),
+}
+
+// types returns a function that reads the datatypes of the columns of the current row of stmt
+// into wasm memory and returns their address
+const types = (stmt, n) => () => {
+  const ptr = stmt.connection.scratch(Math.max(n, 1));
+  sqlite3.wasm_column_types(stmt.handle, ptr, n);
+  return ptr;
+}
+
+// compile generates the source for a decoder factory for the given columns. Keys are quoted, except for
+// __proto__ which is computed so that it's an own property rather than the prototype of the row.
+const compile = (names, kinds) => {
+  const args = kinds.map((_kind, pos) => `r${pos}`);
+  const fields = [], seen = new Set();
+  names.forEach((name, pos) => {
+    if(!seen.has(name)) { // if a name appears more than once, the first column with that name wins
+      seen.add(name);
+      const key = name === '__proto__' ? `[${JSON.stringify(name)}]` : JSON.stringify(name);
+      fields.push(`${key}: r${pos}(${pos}, HEAPU8()[p + ${pos}])`); // memory may grow while reading a column
+    }
+  });
+  return new Function(...args, 'types', 'HEAPU8',
+    `return function decode() { const p = types(); return { ${fields.join(', ')} }; }`);
+}
+
+// Decoder returns a row decoder for the resultset of stmt. Decoders capture the statement's 
+// options at the time they are created.
+export default function decoder(stmt) {
+  const names = stmt.columns();
+  const kinds = names.map((_name, pos) => affinity(sqlite3.sqlite3_column_decltype(stmt.handle, pos)));
+
+  const key = JSON.stringify([names, kinds]);
+  let factory = factories.get(key);
+  if(factory === undefined) {
+    factory = compile(names, kinds);
+    factories.set(key, factory);
+  }
+
+  return factory(...kinds.map(kind => readers[kind](stmt)), types(stmt, names.length), HEAPU8);
+}
@@ -7,6 +7,8 @@
 import Pointer from './pointer';
 import { memory } from './sqlite3'; // delibrate circular imports
 import { UTF8ToString } from './runtime';
+import * as io from './io';
+import { now } from './statistics';
 
 // wasm_crypto_get_random provides implementation of 
 // C extern function with similar name defined in src/os_wasm.h
@@ -21,7 +23,7 @@ export function wasm_crypto_get_random(ptr, n) {
 // wasm_get_unix_epoch provides implementation of
 // C extern function with similar name defined in src/os_wasm.h
 // It returns the current unix epoch time as number of milliseconds.
-export function wasm_get_unix_epoch() { return BigInt(Math.round(Date.now() / 1000)) }
+export function wasm_get_unix_epoch() { return BigInt(Date.now()) }
 
 // checks for nullptr before calling set(...)
 const safeSet = (ptr, ...args) => { if(ptr.p !== 0) ptr.set(...args) }
@@ -36,9 +38,11 @@ export function wasm_http_file_stat(i0, o0, o1) {
   const access = new Pointer(memory, o0);
   const size = new Pointer(memory, o1);
 
+  const start = io.active ? now() : 0;
   let xhr = new XMLHttpRequest();
   xhr.open("HEAD", path, false /* synchronous request */);
   xhr.send();
+  if(io.active) io.request('HEAD', path, 0, start, now() - start, xhr.status !== 200);
 
   if (xhr.status !== 200) { // server must respond with 200
     safeSet(access, 0);
@@ -66,11 +70,13 @@ export function wasm_http_get_bytes(i0, i1, start, end) {
   const path = UTF8ToString(heap, i0);
   const buf  = new Uint8Array(memory.buffer);
 
+  const begin = io.active ? now() : 0;
   let xhr = new XMLHttpRequest();
   xhr.open("GET", path, false /* synchronous request */);
   xhr.responseType = 'arraybuffer';
   xhr.setRequestHeader('Range', `bytes=${start}-${end}`);
   xhr.send();
+  if(io.active) io.request('GET', path, xhr.response ? xhr.response.byteLength : 0, begin, now() - begin, xhr.status !== 206);
   
   if(xhr.status !== 206) { // ensure request succeeded
     return 1;
@@ -92,3 +98,26 @@ export function wasm_console_log(i0, i1) {
 
   console.log(`sqlite3: code=${code} msg=${msg}`);
 }
+
+// wasm_function_call, wasm_aggregate_step, wasm_aggregate_final and wasm_function_destroy
+// provide implementations of the application-defined functions' externs in src/os_wasm.h
+export { wasm_function_call, wasm_aggregate_step, wasm_aggregate_final, wasm_function_destroy } from './functions';
+
+// wasm_vtab_* and wasm_module_destroy provide implementations of the
+// virtual table modules' externs in src/os_wasm.h
+export { 
+  wasm_vtab_connect, wasm_vtab_disconnect, wasm_vtab_best_index, wasm_vtab_filter, 
+  wasm_vtab_fill, wasm_vtab_close, wasm_module_destroy 
+} from './vtab';
+
+// wasm_changes_commit provides implementation of the change feed's extern in src/os_wasm.h
+export { wasm_changes_commit } from './changes';
+
+// wasm_profile_clock provides implementation of the opcode profiler's extern in src/os_wasm.h
+export { wasm_profile_clock } from './opcodes';
+
+// wasm_trace_statement provides implementation of the tracer's extern in src/os_wasm.h
+export { wasm_trace_statement } from './trace';
+
+// wasm_progress provides implementation of the progress handler's extern in src/os_wasm.h
+export { wasm_progress } from './progress';
@@ -0,0 +1,133 @@
+/*
+** functions.js keeps the Javascript implementations of application-defined
+** sql functions (see Connection#function and Connection#aggregate) and provides
+** the environment imports src/wasm_function.c calls into to run them.
+*/
+
+import { memory } from './sqlite3'; // delibrate circular imports
+import { INTEGER, FLOAT, TEXT, BLOB, store, unpack } from './packer';
+import { UTF8Decode } from './runtime';
+
+// registered implementations, keyed by the id handed over to wasm_create_function
+const functions = new Map();
+let nextFunction = 1;
+
+// states of in-progress aggregate evaluations, keyed by the id kept in C's aggregate context
+const states = new Map();
+let nextState = 1;
+
+// Register adds impl to the registry and returns the id that identifies it to C
+export function register(impl) {
+  const id = nextFunction++;
+  functions.set(id, impl);
+  return id;
+}
+
+// fail packs the message of the error e into the slot at ptr, if any, and returns a non-zero code
+const fail = (ptr, e) => {
+  if(ptr !== 0) store(ptr, String(e && e.message || e));
+  return 1; // SQLITE_ERROR
+}
+
+// Column is a single argument of all the rows in a batch handed over to an aggregate's step().
+// types and values are views directly over wasm memory and are only valid until step() returns.
+class Column {
+  constructor(heap, types, values, offsets, lengths, data) {
+    this.heap = heap;
+    this.types = types;     // sqlite3 datatype of each row's value
+    this.values = values;   // INTEGER and FLOAT values, as doubles
+    this.offsets = offsets;
+    this.lengths = lengths;
+    this.data = data;
+  }
+
+  // Value returns the value of row i as a Javascript value
+  value(i) {
+    switch(this.types[i]) {
+      case INTEGER: case FLOAT: return this.values[i];
+      case TEXT: return UTF8Decode(this.heap, this.data + this.offsets[i], this.lengths[i]);
+      case BLOB: {
+        let off = this.data + this.offsets[i];
+        return this.heap.slice(off, off + this.lengths[i]);
+      }
+      default: return null;
+    }
+  }
+}
+
+// batch creates the Javascript view of the wasm_batch at ptr; see src/wasm_function.c for the layout
+const batch = ptr => {
+  const words = new Int32Array(memory.buffer, ptr, 10);
+  const [ nRow, nArg, nAlloc, aType, aNum, aOff, aLen, zData ] = words;
+  const heap = new Uint8Array(memory.buffer);
+
+  const columns = new Array(nArg);
+  for(let j = 0; j < nArg; j++) {
+    let k = j * nAlloc;
+    columns[j] = new Column(heap,
+      new Uint8Array(memory.buffer, aType + k, nRow),
+      new Float64Array(memory.buffer, aNum + k * 8, nRow),
+      new Int32Array(memory.buffer, aOff + k * 4, nRow),
+      new Int32Array(memory.buffer, aLen + k * 4, nRow), zData);
+  }
+  return { length: nRow, columns };
+}
+
+// wasm_function_call provides implementation of
+// C extern function with similar name defined in src/os_wasm.h
+// It calls the scalar function id with the argc arguments packed at argv and packs the result at out.
+export function wasm_function_call(id, argc, argv, out) {
+  try {
+    const { fn } = functions.get(id);
+    store(out, fn(...unpack(argv, argc)));
+    return 0;
+  } catch(e) {
+    return fail(out, e);
+  }
+}
+
+// wasm_aggregate_step provides implementation of
+// C extern function with similar name defined in src/os_wasm.h
+// It folds the batch of rows at ptr into the state of the aggregate evaluation whose id is at pState,
+// creating that state with init() on the first call.
+export function wasm_aggregate_step(id, pState, ptr, err) {
+  try {
+    const { init, step } = functions.get(id);
+    const slot = new Int32Array(memory.buffer, pState, 1);
+    if(slot[0] === 0) {
+      slot[0] = nextState++;
+      states.set(slot[0], init());
+    }
+
+    const state = step(states.get(slot[0]), batch(ptr));
+    if(state !== undefined) states.set(slot[0], state);
+    return 0;
+  } catch(e) {
+    return fail(err, e);
+  }
+}
+
+// wasm_aggregate_final provides implementation of
+// C extern function with similar name defined in src/os_wasm.h
+// It releases the state of the aggregate evaluation and, unless out is NULL, packs final(state) at out.
+// State 0 means no rows were ever stepped, in which case final() is called on a fresh init().
+export function wasm_aggregate_final(id, state, out) {
+  let value = states.get(state);
+  states.delete(state);
+  if(out === 0) return 0;
+
+  try {
+    const { init, final } = functions.get(id);
+    store(out, final(state === 0 ? init() : value));
+    return 0;
+  } catch(e) {
+    return fail(out, e);
+  }
+}
+
+// wasm_function_destroy provides implementation of
+// C extern function with similar name defined in src/os_wasm.h
+// It's called by sqlite3 once the function is deleted or overloaded, or the connection is closed.
+export function wasm_function_destroy(id) {
+  functions.delete(id);
+}
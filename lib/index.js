@@ -1,21 +1,34 @@
 import * as _ from 'lodash';
 import Connection from './connection';
 import sqlite3, { memory, heap } from './sqlite3';
+import { setEnabled } from './stats';
+import * as allocations from './allocations';
+import * as io from './io';
+import * as trace from './trace';
 
-export { load } from './sqlite3';
+export { load, memory, heap } from './sqlite3';
+export { default as opcodes, reset as resetOpcodes } from './opcodes';
+export { default as stats } from './stats';
+export { allocations, io, trace };
+export { default as Scheduler } from './scheduler';
 
 /*
 ** Open opens a new database connection and returns a reference 
-** to the connection object.
+** to the connection object. See Connection for the supported options.
 */
-export function open(arg) {
+export function open(arg, options) {
   let rc = sqlite3.sqlite3_initialize(); // explicitly initialize the library
   if(rc !== 0 /* SQLITE_OK */) {
     throw new Error(`failed to initialize sqlite3: ${sqlite3.sqlite3_errstr(rc)}`);
   }
 
   // open an in-memory database connection
-  const connection = new Connection(":memory:", 0xc2 /* SQLITE_OPEN_READWRITE|SQLITE_OPEN_URI|SQLITE_OPEN_MEMORY */, "memdb");
+  const connection = new Connection(":memory:", 0xc2 /* SQLITE_OPEN_READWRITE|SQLITE_OPEN_URI|SQLITE_OPEN_MEMORY */, "memdb", options);
+
+  if(!_.isArrayBuffer(arg) && connection.options.text === 'utf16') {
+    // store text in a new database as UTF-16 too, so that it never needs to be transcoded
+    connection.exec("PRAGMA encoding = 'UTF-16le'");
+  }
   
   if(_.isArrayBuffer(arg)) {
     const bufferSize = BigInt(arg.byteLength);
@@ -23,6 +36,7 @@ export function open(arg) {
 
     // allocate the memory using sqlite3's memory management routine
     // as this region is later on freed using sqlite3_free (automatically as we use SQLITE_DESERIALIZE_FREEONCLOSE)
+    const prior = allocations.active ? allocations.tag(allocations.MEMDB) : -1;
     let ptr = heap.sqlite3_malloc64(bufferSize);
     
     let buf = new Uint8Array(arg);
@@ -30,6 +44,7 @@ export function open(arg) {
     mem.set(buf, ptr); // copy the buffer into memory
 
     let rc = sqlite3.sqlite3_deserialize(connection.handle, "main", ptr, bufferSize, bufferSize, deserializeFlags);
+    if(prior >= 0) allocations.tag(prior);
     if(rc !== 0) { // !== SQLITE_OK
       throw new Error(sqlite3.sqlite3_errstr(rc));
     }
@@ -37,3 +52,24 @@ export function open(arg) {
   
   return connection;
 }
+
+/*
+** MemoryStatus turns the collection of sqlite3's memory statistics (see stats()) on or off.
+** It's off by default, as it costs on every allocation. The library has to be shut down to
+** change it once initialized, so it can only be called while no connection is open, counting
+** connections closed with statements not finalized yet (see Connection#close).
+*/
+export function memoryStatus(enable) {
+  let rc = sqlite3.wasm_memstatus(enable ? 1 : 0);
+  if(rc === 21 /* SQLITE_MISUSE */) { // already initialized
+    if(Connection.open > 0) {
+      throw new Error('memory status can only be changed while no connection is open (or has statements not finalized)');
+    }
+    sqlite3.sqlite3_shutdown(); // open() initializes it again
+    rc = sqlite3.wasm_memstatus(enable ? 1 : 0);
+  }
+  if(rc !== 0) { // !== SQLITE_OK
+    throw new Error(sqlite3.sqlite3_errstr(rc));
+  }
+  setEnabled(!!enable);
+}
@@ -0,0 +1,51 @@
+/*
+** InternTable is a bounded table of decoded strings keyed by their UTF-8 bytes.
+** It lets low-cardinality text columns (country codes, status enums, ...) hand out
+** the same string instance for repeated values instead of decoding and allocating
+** a new one for every row.
+*/
+
+import { UTF8Decode } from './runtime';
+
+export default class InternTable {
+
+  // create a new table that holds at most capacity strings, each at most maxLength bytes long,
+  // using decode to convert bytes into strings
+  constructor(capacity = 256, maxLength = 32, decode = UTF8Decode) {
+    this.capacity = capacity;
+    this.maxLength = maxLength;
+    this.convert = decode;
+    this.entries = new Map(); // hash of the bytes -> { bytes, str }
+  }
+
+  // Decode returns the string for the length bytes at ptr, re-using a previously decoded
+  // instance when there's one. Values too long to be interned are decoded as usual, as are
+  // new values once the table is full.
+  decode(heap, ptr, length) {
+    if(length > this.maxLength) {
+      return this.convert(heap, ptr, length);
+    }
+
+    // FNV-1a hash of the bytes
+    let hash = 0x811c9dc5;
+    for(let i = 0; i < length; i++) {
+      hash = Math.imul(hash ^ heap[ptr + i], 0x01000193);
+    }
+
+    let entry = this.entries.get(hash);
+    if(entry !== undefined) {
+      let bytes = entry.bytes, i = 0;
+      if(bytes.length === length) {
+        while(i < length && bytes[i] === heap[ptr + i]) i++;
+        if(i === length) return entry.str;
+      }
+      return this.convert(heap, ptr, length); // collision; leave the existing entry alone
+    }
+
+    let str = this.convert(heap, ptr, length);
+    if(this.entries.size < this.capacity) {
+      this.entries.set(hash, { bytes: heap.slice(ptr, ptr + length), str });
+    }
+    return str;
+  }
+}
@@ -0,0 +1,138 @@
+/*
+** io.js accounts for the requests the http vfs makes (wasm_http_get_bytes and
+** wasm_http_file_stat in lib/environment.js): their number, the bytes fetched
+** and their latency, attributing them to the statement being executed. The
+** page cache hits and misses of the statement are counted alongside, as it's
+** the cache sitting in front of the requests. Every request can also be kept
+** as a Trace Event (see lib/trace.js).
+*/
+
+import * as _ from 'lodash';
+import sqlite3, { memory, stack } from './sqlite3'; // delibrate circular imports
+import { now, shapeOf, bucket, percentile, BUCKETS } from './statistics';
+
+// index of the SQLITE_DBSTATUS_CACHE_HIT and SQLITE_DBSTATUS_CACHE_MISS pairs read by wasm_db_status; see src/wasm_status.c
+const CACHE_HIT = 5, CACHE_MISS = 6, DB_STATUS = 11;
+
+// key requests made outside of any statement (as when a database is opened) are accounted under
+const NONE = '';
+
+// whether requests are being accounted for
+export let active = false;
+
+// whether requests are kept as trace events, and the most kept
+let tracing = false, limit = 0;
+
+// accounting per statement, by query shape, and the trace events kept
+const queries = new Map();
+let events = [];
+
+// the query shape and connection of the statement being executed, and it's connection's cache counters when it started
+let current = { key: NONE, connection: null, hits: 0, misses: 0 };
+
+// Enable starts accounting for requests. options can contain:
+//   - trace: true to keep every request as a trace event (default false)
+//   - traceLimit: most trace events kept, the oldest being dropped first (default 10000)
+export function enable(options = {}) {
+  active = true;
+  tracing = !!options.trace;
+  limit = options.traceLimit || 10000;
+}
+
+// Disable stops accounting for requests; what was accounted for so far is kept until reset
+export function disable() {
+  active = false;
+  tracing = false;
+}
+
+// entry returns the accounting of the query shape key
+const entry = key => {
+  let q = queries.get(key);
+  if(q === undefined) {
+    q = { sql: key || null, requests: 0, stats: 0, errors: 0, bytes: 0, time: 0, max: 0, cacheHits: 0, cacheMisses: 0, histogram: new Uint32Array(BUCKETS) };
+    queries.set(key, q);
+  }
+  return q;
+}
+
+// cache returns the page cache [ hits, misses ] of connection so far
+const cache = connection => {
+  const esp = stack.save();
+  try {
+    const ptr = stack.alloc(DB_STATUS * 2 * 4);
+    sqlite3.wasm_db_status(connection.handle, ptr, 0);
+    const values = new Int32Array(memory.buffer, ptr, DB_STATUS * 2);
+    return [ values[CACHE_HIT * 2], values[CACHE_MISS * 2] ];
+  } finally {
+    stack.restore(esp);
+  }
+}
+
+// Enter makes stmt the statement requests are attributed to, until leave is called
+// with what it returns
+export function enter(stmt) {
+  const prior = current;
+  const [ hits, misses ] = cache(stmt.connection);
+  current = { key: shapeOf(stmt), connection: stmt.connection, hits, misses };
+  return prior;
+}
+
+// Leave accounts for the page cache hits and misses of the statement entered last
+// and makes prior, returned by enter, current again
+export function leave(prior) {
+  const [ hits, misses ] = cache(current.connection);
+  const q = entry(current.key);
+  q.cacheHits += Math.max(hits - current.hits, 0); // the counters may have been reset in between
+  q.cacheMisses += Math.max(misses - current.misses, 0);
+  current = prior;
+}
+
+// Request accounts for a request made by the http vfs: a GET of bytes bytes or a HEAD (stat) of url,
+// which started at start (see now()) and took time milliseconds. failed is set if it didn't succeed.
+export function request(method, url, bytes, start, time, failed) {
+  const q = entry(current.key);
+  if(method === 'HEAD') q.stats += 1; else q.requests += 1;
+  q.errors += failed ? 1 : 0;
+  q.bytes += bytes;
+  q.time += time;
+  q.max = Math.max(q.max, time);
+  q.histogram[bucket(time)] += 1;
+
+  if(tracing) {
+    events.push({
+      name: `${method} ${url}`, cat: 'http', ph: 'X', ts: start * 1000, dur: time * 1000, pid: 1, tid: 1,
+      args: { bytes, failed: !!failed, sql: current.key || null },
+    });
+    if(events.length > limit) events.shift();
+  }
+}
+
+// summary returns the accounting q as reported by report()
+const summary = ({ histogram, ...q }) => {
+  const n = q.requests + q.stats;
+  return { ...q, mean: n > 0 ? q.time / n : 0, p50: Math.min(percentile(histogram, n, 0.5), q.max), p95: Math.min(percentile(histogram, n, 0.95), q.max) };
+}
+
+// counters summed up into the total reported by report()
+const TOTALS = [ 'requests', 'stats', 'errors', 'bytes', 'time', 'cacheHits', 'cacheMisses' ];
+
+// Report returns the requests made since the last reset, per query shape, with the most time consuming first:
+// the number of range requests and stat requests, failures, bytes fetched, total / mean / max / p50 / p95
+// latency in milliseconds and the page cache hits and misses. Requests made outside of any statement
+// have a null sql. total sums them all up. Set reset to start over.
+export function report(reset = false) {
+  const entries = _.orderBy([ ...queries.values() ].map(summary), 'time', 'desc');
+  const total = _.zipObject(TOTALS, TOTALS.map(name => _.sumBy(entries, name)));
+  if(reset) {
+    queries.clear();
+  }
+  return { total, queries: entries };
+}
+
+// TraceEvents returns the requests kept as trace events, oldest first, and forgets them. Timestamps
+// are in microseconds, on the clock of now().
+export function traceEvents() {
+  const kept = events;
+  events = [];
+  return kept;
+}
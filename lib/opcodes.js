@@ -0,0 +1,63 @@
+/*
+** opcodes.js reads the per-opcode execution counters collected by the
+** sqlite3.profile.wasm build (see src/wasm_profile.h and src/wasm_profile.c),
+** either of a single statement or of all statements, as a table of
+** { opcode, count, time, average } rows.
+*/
+
+import * as _ from 'lodash';
+import sqlite3, { memory, heap } from './sqlite3'; // delibrate circular imports
+import { UTF8ToString } from './runtime';
+
+// size of a wasm_opcode_stat in bytes; see src/wasm_profile.c
+const STAT = 24;
+
+// clock returns a monotonic timestamp in nanoseconds, as a BigInt
+const clock = typeof process !== 'undefined' && process.hrtime && process.hrtime.bigint ?
+  () => process.hrtime.bigint() :
+  () => BigInt(Math.round(performance.now() * 1e6));
+
+// wasm_profile_clock provides implementation of
+// C extern function with similar name defined in src/os_wasm.h
+// It's called twice for every opcode executed by the profiling build, so it must be cheap.
+export function wasm_profile_clock() { return clock() }
+
+// Opcodes returns the counters of the opcodes executed by statements with the SQL text sql, or by
+// all statements if sql is null, ordered by the time spent in them. time and average are in milliseconds,
+// with the cost of reading the clock taken out. Counters of a statement are only collected when it's
+// reset or finalized. It throws unless sqlite3.profile.wasm is loaded.
+export default function opcodes(sql = null) {
+  if(!sqlite3.wasm_profile_enabled()) {
+    throw new Error('opcode counters are only collected by sqlite3.profile.wasm');
+  }
+
+  let n = 64, ptr, count;
+  for(;;) {
+    ptr = heap.malloc(n * STAT);
+    count = sqlite3.wasm_profile_opcodes(sql, ptr, n);
+    if(count <= n) break;
+    heap.free(ptr);
+    n = count;
+  }
+
+  const view = new DataView(memory.buffer);
+  const mem = new Uint8Array(memory.buffer);
+  const result = _.times(count, i => {
+    let p = ptr + i * STAT;
+    const calls = Number(view.getBigUint64(p + 8, true));
+    const time = Number(view.getBigUint64(p + 16, true)) / 1e6;
+    return {
+      opcode: UTF8ToString(mem, view.getInt32(p, true)),
+      count: calls,
+      time,
+      average: calls > 0 ? time / calls : 0,
+    };
+  });
+  heap.free(ptr);
+  return _.orderBy(result, 'time', 'desc');
+}
+
+// Reset clears the counters of all statements
+export function reset() {
+  sqlite3.wasm_profile_reset();
+}
@@ -0,0 +1,192 @@
+/*
+** packer.js encodes Javascript values into the packed value format
+** declared in src/wasm_value.h, so that whole sets of values can be handed
+** over to C in a single call instead of one call per value.
+*/
+
+import * as _ from 'lodash';
+import { memory, heap } from './sqlite3';
+import { lengthBytesUTF8, stringToUTF8, stringToUTF16, UTF8Decode, UTF16Decode } from './runtime';
+
+// size of a single wasm_value slot in bytes
+export const SLOT = 16;
+
+// slot types; must be kept in sync with src/wasm_value.h
+export const SKIP = 0, INTEGER = 1, FLOAT = 2, TEXT = 3, BLOB = 4, NULL = 5, TEXT16 = 6;
+
+// bytes returns the Uint8Array view over val if it's a blob-like value, else undefined
+const bytes = val => {
+  if(_.isArrayBuffer(val)) return new Uint8Array(val);
+  if(ArrayBuffer.isView(val)) return new Uint8Array(val.buffer, val.byteOffset, val.byteLength);
+}
+
+// payload returns the number of bytes val needs beyond it's slot
+const payload = (val, utf16) => {
+  if(_.isString(val)) {
+    return utf16? (val.length << 1) + 1 /* +1 for alignment */ : lengthBytesUTF8(val) + 1 /* +1 for the trailing '\0' */;
+  }
+  let b = bytes(val);
+  return b !== undefined ? b.byteLength : 0;
+}
+
+// each invokes fn(slot, value) for every value in the row. Arrays are bound by position
+// while objects are bound by name, using layout to map a parameter name to it's (1-based) index.
+// Names that are not present in the layout are ignored.
+const each = (row, layout, fn) => {
+  if(_.isArray(row)) {
+    for(let i = 0; i < row.length; i++) fn(i, row[i]);
+  } else if(row !== null && row !== undefined) {
+    for(const name in row) {
+      let idx = layout.get(name);
+      if(idx !== undefined) fn(idx - 1, row[name]);
+    }
+  }
+}
+
+// scalar packs val into the slot at p if it's a value that fits in the slot itself (a number, 
+// a bigint, a boolean or null) and returns whether it did
+const scalar = (view, p, val) => {
+  if(typeof val === 'bigint') {
+    if(BigInt.asIntN(64, val) !== val) {
+      throw new RangeError(`integer out of range: ${val}`);
+    }
+    view.setInt32(p, INTEGER, true);
+    view.setBigInt64(p + 8, val, true);
+  } else if(_.isBoolean(val) || val === (val | 0)) {
+    view.setInt32(p, INTEGER, true);
+    view.setInt32(p + 8, +val, true);
+    view.setInt32(p + 12, val < 0 ? -1 : 0, true); // sign-extend into the high word
+  } else if(Number.isSafeInteger(val)) {
+    view.setInt32(p, INTEGER, true);
+    view.setBigInt64(p + 8, BigInt(val), true);
+  } else if(_.isNumber(val)) {
+    view.setInt32(p, FLOAT, true);
+    view.setFloat64(p + 8, val, true);
+  } else if(val === null || val === undefined) {
+    view.setInt32(p, NULL, true);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Measure returns the number of bytes needed to pack rows of nParam slots each. 
+// utf16 must match the value passed to pack.
+export function measure(rows, nParam, layout, utf16 = false) {
+  let size = rows.length * nParam * SLOT;
+  for(let r = 0; r < rows.length; r++) {
+    each(rows[r], layout, (_slot, val) => { size += payload(val, utf16) });
+  }
+  return size;
+}
+
+// Pack writes rows of nParam slots each into wasm memory starting at ptr; ptr must be
+// 8-byte aligned and have at least measure(rows, nParam, layout, options.utf16) bytes available. 
+// Parameters without a value in a row get a slot of type options.missing (SKIP, the default, to leave 
+// the binding untouched, or NULL). Strings are packed as UTF-8 TEXT unless options.utf16 is set,
+// in which case they are copied as is as TEXT16. Offsets of the bytes are relative to ptr.
+export function pack(ptr, rows, nParam, layout, options = {}) {
+  const { missing = SKIP, utf16 = false } = options;
+  const view = new DataView(memory.buffer);
+  const heap = new Uint8Array(memory.buffer);
+  let data = rows.length * nParam * SLOT; // offset where the next TEXT or BLOB payload goes
+
+  for(let r = 0; r < rows.length; r++) {
+    let base = ptr + r * nParam * SLOT;
+    for(let i = 0; i < nParam; i++) {
+      view.setInt32(base + i * SLOT, missing, true);
+    }
+
+    each(rows[r], layout, (slot, val) => {
+      if(slot >= nParam) {
+        throw new RangeError(`parameter ${slot + 1} out of range`);
+      }
+
+      let p = base + slot * SLOT;
+      if(_.isString(val) && utf16) {
+        data += data & 1; // UTF-16 code units must be 2-byte aligned
+        let n = stringToUTF16(val, ptr + data);
+        view.setInt32(p, TEXT16, true);
+        view.setInt32(p + 4, n, true);
+        view.setInt32(p + 8, data, true);
+        data += n;
+      } else if(_.isString(val)) {
+        let n = stringToUTF8(val, heap, ptr + data, lengthBytesUTF8(val) + 1);
+        view.setInt32(p, TEXT, true);
+        view.setInt32(p + 4, n, true);
+        view.setInt32(p + 8, data, true);
+        data += n + 1;
+      } else if(scalar(view, p, val)) {
+        // numbers, booleans and nulls are packed into the slot itself
+      } else {
+        let b = bytes(val);
+        if(b === undefined) {
+          throw new Error(`unsupported type: ${typeof val}`);
+        }
+        heap.set(b, ptr + data);
+        view.setInt32(p, BLOB, true);
+        view.setInt32(p + 4, b.byteLength, true);
+        view.setInt32(p + 8, data, true);
+        data += b.byteLength;
+      }
+    });
+  }
+}
+
+// Store packs the single value val into the slot at ptr. The bytes of TEXT and BLOB values are
+// copied into memory allocated with malloc, referenced by their absolute address (ie. relative to 0),
+// and are owned by whoever receives the slot.
+export function store(ptr, val) {
+  let type, n, payload;
+  if(_.isString(val)) {
+    n = lengthBytesUTF8(val);
+    payload = heap.malloc(n + 1);
+    stringToUTF8(val, new Uint8Array(memory.buffer), payload, n + 1);
+    type = TEXT;
+  } else if(bytes(val) !== undefined) {
+    let b = bytes(val);
+    n = b.byteLength;
+    payload = heap.malloc(Math.max(n, 1));
+    new Uint8Array(memory.buffer).set(b, payload);
+    type = BLOB;
+  }
+
+  const view = new DataView(memory.buffer); // created after malloc, which might have grown the memory
+  if(type === undefined) {
+    if(!scalar(view, ptr, val)) {
+      throw new Error(`unsupported type: ${typeof val}`);
+    }
+  } else {
+    view.setInt32(ptr, type, true);
+    view.setInt32(ptr + 4, n, true);
+    view.setInt32(ptr + 8, payload, true);
+  }
+}
+
+// Unpack decodes n slots starting at ptr into an array of Javascript values. Integers are returned as 
+// numbers when they fit in a safe integer and as BigInt otherwise, TEXT as strings and BLOB as copied 
+// Uint8Arrays. Offsets of the bytes are relative to base.
+export function unpack(ptr, n, base = 0) {
+  const view = new DataView(memory.buffer);
+  const heap = new Uint8Array(memory.buffer);
+  const values = new Array(n);
+
+  for(let i = 0; i < n; i++) {
+    let p = ptr + i * SLOT;
+    switch(view.getInt32(p, true)) {
+      case INTEGER: {
+        let hi = view.getInt32(p + 12, true), lo = view.getUint32(p + 8, true);
+        values[i] = (hi >= -0x200000 && hi < 0x200000)? hi * 0x100000000 + lo : view.getBigInt64(p + 8, true);
+      } break;
+      case FLOAT: values[i] = view.getFloat64(p + 8, true); break;
+      case TEXT: values[i] = UTF8Decode(heap, base + view.getInt32(p + 8, true), view.getInt32(p + 4, true)); break;
+      case TEXT16: values[i] = UTF16Decode(heap, base + view.getInt32(p + 8, true), view.getInt32(p + 4, true)); break;
+      case BLOB: {
+        let off = base + view.getInt32(p + 8, true);
+        values[i] = heap.slice(off, off + view.getInt32(p + 4, true));
+      } break;
+      default: values[i] = null;
+    }
+  }
+  return values;
+}
@@ -4,18 +4,28 @@
 ** stack or heap depending on the subclass.
 */
 let Pointer = function(memory, handle) {
+  this.memory = memory;
   this.view = new Int32Array(memory.buffer);
   this.p = handle;
 }
 
+// Heap returns a view on the memory, recreating it if the memory 
+// has grown (and detached the previous buffer) since the last access
+Pointer.prototype.heap = function() {
+  if(this.view.byteLength === 0) {
+    this.view = new Int32Array(this.memory.buffer);
+  }
+  return this.view;
+}
+
 // Get returns the current address stored inside the pointer
 Pointer.prototype.get = function() {
-  return this.view[this.p >> 2];
+  return this.heap()[this.p >> 2];
 }
 
 // Set sets the address value inside the pointer
 Pointer.prototype.set = function(addr) {
-  this.view[this.p >> 2] = addr;
+  this.heap()[this.p >> 2] = addr;
 }
 
 export default Pointer;
\ No newline at end of file
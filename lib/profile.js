@@ -0,0 +1,132 @@
+/*
+** profile.js runs a statement to completion while measuring it, and joins
+** it's EXPLAIN QUERY PLAN with the per-loop counters of sqlite3_stmt_scanstatus
+** (see src/wasm_scanstatus.c) into a tree that can be inspected or printed.
+*/
+
+import * as _ from 'lodash';
+import sqlite3, { memory, heap } from './sqlite3';
+import { UTF8ToString } from './runtime';
+
+// size of a wasm_scan in bytes; see src/wasm_scanstatus.c
+const SCAN = 40;
+
+// now returns a high-resolution timestamp in milliseconds
+const now = () => (typeof performance !== 'undefined'? performance.now() : Date.now());
+
+// scans reads the scanstatus counters of every loop of the statement
+const scans = handle => {
+  let n = 16, ptr, count;
+  for(;;) {
+    ptr = heap.malloc(n * SCAN);
+    count = sqlite3.wasm_stmt_scanstatus(handle, ptr, n);
+    if(count <= n) break;
+    heap.free(ptr);
+    n = count;
+  }
+
+  const view = new DataView(memory.buffer);
+  const mem = new Uint8Array(memory.buffer);
+  const result = _.times(count, i => {
+    let p = ptr + i * SCAN;
+    return {
+      loops: Number(view.getBigInt64(p, true)),
+      visited: Number(view.getBigInt64(p + 8, true)),
+      estimated: view.getFloat64(p + 16, true),
+      name: UTF8ToString(mem, view.getInt32(p + 24, true)),
+      detail: UTF8ToString(mem, view.getInt32(p + 28, true)),
+      id: view.getInt32(p + 32, true),
+    };
+  });
+  heap.free(ptr);
+  return result;
+}
+
+// render appends the lines of the nodes, drawn as a tree like the sqlite3 shell does, to lines
+const render = (nodes, prefix, lines) => {
+  nodes.forEach((node, i) => {
+    const last = i === nodes.length - 1;
+    let line = `${prefix}${last ? '`--' : '|--'}${node.detail}`;
+    if(node.loops !== undefined) {
+      const actual = node.loops > 0 ? node.visited / node.loops : 0;
+      line += `  (loops=${node.loops} rows=${node.visited} est=${_.round(node.estimated, 1)}/loop actual=${_.round(actual, 1)}/loop)`;
+    }
+    lines.push(line);
+    render(node.children, prefix + (last ? '   ' : '|  '), lines);
+  });
+}
+
+/*
+** Profile is the outcome of Statement#profile: the wall time spent stepping the statement,
+** the number of rows it returned, and the query plan as a tree of nodes. Each node has the
+** EXPLAIN QUERY PLAN detail and children and, for loops, the scanstatus counters: loops (times
+** the loop was run), visited (rows visited across all runs) and estimated (rows per run, as
+** estimated by the query planner).
+*/
+export class Profile {
+  constructor(sql, time, rows, plan) {
+    this.sql = sql;
+    this.time = time;   // milliseconds
+    this.rows = rows;
+    this.plan = plan;
+  }
+
+  // toString renders the plan as a tree along with the timings
+  toString() {
+    const lines = [ `QUERY PLAN  (${_.round(this.time, 3)} ms, ${this.rows} rows)` ];
+    render(this.plan, '', lines);
+    return lines.join('\n');
+  }
+}
+
+// Profile runs stmt to completion, with params bound if given, and returns it's Profile.
+// Rows returned by the statement are discarded.
+export default function profile(stmt, params) {
+  const handle = stmt.handle;
+  const sql = sqlite3.sqlite3_sql(handle);
+
+  stmt._record();
+  stmt.generation += 1;
+  sqlite3.sqlite3_reset(handle);
+  stmt.bindParams(params);
+  sqlite3.sqlite3_stmt_scanstatus_reset(handle);
+
+  let rows = 0;
+  const start = now();
+  while(stmt.step()) rows++;
+  const time = now() - start;
+  const loops = scans(handle);
+  sqlite3.sqlite3_reset(handle);
+
+  // the node ids of EXPLAIN QUERY PLAN match the select ids of the loops, as the plan is the same;
+  // loops are matched by their detail text should the ids ever disagree
+  const nodes = new Map();
+  const eqp = stmt.connection.prepare(`EXPLAIN QUERY PLAN ${sql}`);
+  try {
+    while(eqp.step()) {
+      const [ id, parent, /* notused */, detail ] = eqp.get();
+      nodes.set(Number(id), { id: Number(id), parent: Number(parent), detail, children: [] });
+    }
+  } finally {
+    eqp.finalize();
+  }
+
+  const roots = [];
+  loops.forEach(loop => {
+    let node = nodes.get(loop.id);
+    if(node === undefined || node.detail !== loop.detail) {
+      node = _.find([ ...nodes.values() ], n => n.detail === loop.detail && n.loops === undefined);
+    }
+    if(node !== undefined) {
+      _.assign(node, _.pick(loop, 'loops', 'visited', 'estimated', 'name'));
+    } else {
+      nodes.set(`loop:${loop.id}`, { ...loop, parent: 0, children: [] }); // loop without a plan node; keep it at the root
+    }
+  });
+  nodes.forEach(node => {
+    const parent = nodes.get(node.parent);
+    (parent !== undefined && parent !== node ? parent.children : roots).push(node);
+  });
+
+  return new Profile(sql, time, rows, roots);
+}
@@ -0,0 +1,89 @@
+/*
+** progress.js keeps the state of the progress handler of connections (see
+** src/wasm_progress.c), which is called every few virtual machine
+** instructions and interrupts the statement running when it's cancellation
+** flag is set or it's deadline has passed. It also counts the instructions
+** run, for Statement#slices to end a time slice on. The handler is only
+** installed for as long as any of those is in use.
+*/
+
+import sqlite3 from './sqlite3'; // delibrate circular imports
+import { now } from './statistics';
+
+// state of the progress handler of every connection that has one, by handle
+const watched = new Map();
+
+// wasm_progress provides implementation of
+// C extern function with similar name defined in src/os_wasm.h
+// It's called every state.interval instructions and returns 1 to interrupt the statement running.
+export function wasm_progress(db) {
+  const state = watched.get(db);
+  if(state === undefined) return 0;
+  state.instructions += state.interval;
+  if(!cancelled(state)) return 0;
+  if(idle(state)) uninstall(db); // the deadline fired, and nothing else needs the handler
+  return 1;
+}
+
+// Cancelled returns whether the statements of the connection with state should be interrupted. The
+// deadline is cleared once it has passed, so that it only interrupts the statement running then.
+export function cancelled(state) {
+  if(state.flag !== null && Atomics.load(state.flag, state.index) !== 0) return true;
+  if(now() > state.deadline) {
+    state.deadline = Infinity;
+    return true;
+  }
+  return false;
+}
+
+// idle returns whether the progress handler with state has nothing to check or count
+const idle = state => state.flag === null && state.deadline === Infinity && state.slices === 0;
+
+// uninstall removes the progress handler of the connection with handle
+const uninstall = handle => {
+  watched.delete(handle);
+  sqlite3.wasm_progress_handler(handle, 0);
+}
+
+// Watch installs the progress handler of connection, if it doesn't have one yet, calling it every
+// connection.options.progressInterval instructions, and returns it's state: the cancellation flag
+// (flag[index], an Int32Array), the deadline (see now()), the number of instructions run and the
+// number of Statement#slices running. Call settle once done changing it.
+export function watch(connection) {
+  let state = watched.get(connection.handle);
+  if(state === undefined) {
+    const interval = connection.options.progressInterval;
+    state = { flag: null, index: 0, deadline: Infinity, instructions: 0, interval, slices: 0 };
+    watched.set(connection.handle, state);
+    sqlite3.wasm_progress_handler(connection.handle, interval);
+  }
+  return state;
+}
+
+// Settle removes the progress handler of connection once there's no cancellation flag, deadline or
+// Statement#slices left for it, so that statements don't pay for it
+export function settle(connection) {
+  const state = watched.get(connection.handle);
+  if(state !== undefined && idle(state)) uninstall(connection.handle);
+}
+
+// Deadline returns the deadline of connection (see now()), or Infinity if it has none
+export function deadline(connection) {
+  const state = watched.get(connection.handle);
+  return state === undefined ? Infinity : state.deadline;
+}
+
+// Unwatch forgets the state of connection, which is being closed
+export function unwatch(connection) {
+  watched.delete(connection.handle);
+}
+
+// YieldNow returns a promise resolved once the event loop had a chance to process other tasks. A message
+// to self is used where available, as timers are clamped to several milliseconds once nested.
+export const yieldNow = typeof MessageChannel !== 'undefined' ?
+  () => new Promise(resolve => {
+    const { port1, port2 } = new MessageChannel();
+    port1.onmessage = () => { port1.close(); resolve() };
+    port2.postMessage(null);
+  }) :
+  () => new Promise(resolve => setTimeout(resolve, 0));
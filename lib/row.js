@@ -0,0 +1,42 @@
+/*
+** row.js builds lazy row accessors for statements (see Statement#row).
+** Each statement gets it's own class, with a getter per column defined once on the
+** prototype, so rows share a single shape and the column name to index mapping
+** is computed only once per statement.
+*/
+
+// private fields of a row; symbols can't clash with column names
+const STMT = Symbol('stmt'), GENERATION = Symbol('generation');
+
+// rowClass returns a new row accessor class for a resultset with the given column names.
+// If a name appears more than once, the first column with that name wins. A column named constructor
+// replaces Row.prototype.constructor, like any other column would.
+export default function rowClass(names) {
+  class Row {
+    constructor(stmt) {
+      this[STMT] = stmt;
+      this[GENERATION] = stmt.generation;
+    }
+  }
+
+  const seen = new Set();
+  names.forEach((name, pos) => {
+    if(seen.has(name)) {
+      return;
+    }
+    seen.add(name);
+
+    Object.defineProperty(Row.prototype, name, {
+      enumerable: true,
+      get() {
+        const stmt = this[STMT];
+        if(this[GENERATION] !== stmt.generation) {
+          throw new Error(`stale row: statement has moved past the row column '${name}' was read from`);
+        }
+        return stmt.column(pos);
+      }
+    });
+  });
+
+  return Row;
+}
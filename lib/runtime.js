@@ -50,23 +50,42 @@ export function stringToUTF8(str, heap, outIdx, max) {
 
 
 /*
-** UTF8ArrayToString converts an array of UTF-8 characters to a Javascript string
+** lengthBytesUTF8 returns the number of bytes the Javascript string takes up when encoded as UTF-8,
+** excluding the null terminator
 */
-export function UTF8ArrayToString(heap, idx, max) {
-  var decoder = new TextDecoder('utf8')
-  var endIdx = idx + max;
-  var endPtr = idx;
-  
-  // TextDecoder needs to know the byte length in advance, it doesn't stop on null terminator by itself.
-  // Also, use the length info to avoid running tiny strings through TextDecoder, since .subarray() allocates garbage.
-  // (As a tiny code save trick, compare endPtr against endIdx using a negation, so that undefined means Infinity)
-  while (heap[endPtr] && !(endPtr >= endIdx)) ++endPtr;
+export function lengthBytesUTF8(str) {
+  let len = 0;
+  for (let i = 0; i < str.length; ++i) {
+    let u = str.charCodeAt(i); // possibly a lead surrogate
+    if (u <= 0x7F) {
+      len += 1;
+    } else if (u <= 0x7FF) {
+      len += 2;
+    } else if (u >= 0xD800 && u <= 0xDFFF) {
+      len += 4; ++i; // surrogate pair encodes a single 4-byte code point
+    } else {
+      len += 3;
+    }
+  }
+  return len;
+}
+
 
-  if (endPtr - idx > 16 && heap.subarray && decoder) {
+// decoder is shared by all the decoding routines as constructing a TextDecoder is not cheap
+const decoder = new TextDecoder('utf8');
+
+/*
+** UTF8Decode converts exactly length bytes of UTF-8 characters, starting at idx, to a Javascript string.
+** Unlike UTF8ArrayToString it doesn't need to scan for the null terminator.
+*/
+export function UTF8Decode(heap, idx, length) {
+  let endPtr = idx + length;
+
+  // use the length info to avoid running tiny strings through TextDecoder, since .subarray() allocates garbage.
+  if (length > 16 && heap.subarray) {
     return decoder.decode(heap.subarray(idx, endPtr));
   } else {
     var str = '';
-    // If building with TextDecoder, we have already computed the string length above, so test loop end condition against that
     while (idx < endPtr) {
       // For UTF8 byte structure, see:
       // http://en.wikipedia.org/wiki/UTF-8#Description
@@ -90,10 +109,55 @@ export function UTF8ArrayToString(heap, idx, max) {
         str += String.fromCharCode(0xD800 | (ch >> 10), 0xDC00 | (ch & 0x3FF));
       }
     }
+    return str;
+  }
+}
+
+// decoder16 is shared by all the UTF-16 decoding routines
+const decoder16 = new TextDecoder('utf-16le');
+
+/*
+** UTF16Decode converts length bytes of UTF-16 (little-endian) code units, starting at idx, to a Javascript string.
+** It reads the code units byte-wise as sqlite3 doesn't guarantee UTF-16 text to be 2-byte aligned.
+*/
+export function UTF16Decode(heap, idx, length) {
+  if (length > 32) {
+    return decoder16.decode(heap.subarray(idx, idx + length));
+  }
+
+  var str = '';
+  for (var endPtr = idx + length; idx < endPtr; idx += 2) {
+    str += String.fromCharCode(heap[idx] | (heap[idx + 1] << 8));
   }
   return str;
 }
 
+/*
+** stringToUTF16 copies the UTF-16 code units of the Javascript string, as is, into the heap starting at 
+** outIdx (which must be 2-byte aligned), and returns the number of bytes written. No terminator is written.
+*/
+export function stringToUTF16(str, outIdx) {
+  const heap = new Uint16Array(memory.buffer, outIdx, str.length);
+  for (let i = 0; i < str.length; ++i) {
+    heap[i] = str.charCodeAt(i);
+  }
+  return str.length << 1;
+}
+
+/*
+** UTF8ArrayToString converts an array of UTF-8 characters to a Javascript string
+*/
+export function UTF8ArrayToString(heap, idx, max) {
+  var endIdx = idx + max;
+  var endPtr = idx;
+  
+  // TextDecoder needs to know the byte length in advance, it doesn't stop on null terminator by itself.
+  // (As a tiny code save trick, compare endPtr against endIdx using a negation, so that undefined means Infinity)
+  while (heap[endPtr] && !(endPtr >= endIdx)) ++endPtr;
+
+  return UTF8Decode(heap, idx, endPtr - idx);
+}
+
 /*
 ** UTF8ToString converts a UTF-8 C string to a Javascript string
 */
@@ -102,6 +166,21 @@ export function UTF8ToString(heap, ptr, max) {
 }
 
 
+// u8 caches a view over the whole wasm memory; see HEAPU8
+let u8 = null;
+
+/*
+** HEAPU8 returns a Uint8Array view over the whole wasm memory. The view is cached
+** and only recreated when growing the memory has detached the previous buffer.
+*/
+export function HEAPU8() {
+  if (u8 === null || u8.byteLength === 0) {
+    u8 = new Uint8Array(memory.buffer);
+  }
+  return u8;
+}
+
+
 /*
 ** ccall invokes the provided function and takes care of argument type conversion
 ** between C and Javascript environments.
@@ -113,7 +192,9 @@ export function ccall(fn, returnType, argTypes, args) {
   const converters = {
     'string': function(str) {
       let ret = 0;
-      if (str !== null && str !== undefined && str !== 0) { // null string
+      if (_.isNumber(str)) { // caller has already marshalled the string and is passing in a pointer
+        ret = str;
+      } else if (str !== null && str !== undefined) { // null string
         // at most 4 bytes per UTF-8 code point, +1 for the trailing '\0'
         let len = (str.length << 2) + 1;
         ret = stack.alloc(len);
@@ -0,0 +1,154 @@
+/*
+** Scheduler runs the queries of many callers sharing a connection (say, the
+** components of a page talking to a single worker) by priority instead of
+** in the order they arrive. Queries run in time slices, in between rows,
+** returning to the event loop after every slice so that new queries get
+** scheduled: interactive queries always go first and background ones only
+** get the slices left over, queries of the same priority taking turns.
+** Queries past their deadline are dropped before they run, and interrupted
+** if they run past it (see Connection#timeout).
+**
+** Slices end in between rows only, so a query that has to do all of it's
+** work before returning it's first row (an ORDER BY that needs a full sort,
+** an aggregate) runs as a single slice, up to it's deadline. And interleaved
+** queries share the connection, and so it's transaction: there's no snapshot
+** isolation between them. A write run while a query is suspended half-way
+** may or may not show in the rows that query returns next, as sqlite3 leaves
+** that undefined; run writes that must not race with queries on a
+** connection of their own.
+*/
+
+import * as _ from 'lodash';
+import { now } from './statistics';
+import { watch, settle, deadline, yieldNow } from './progress';
+
+// priority classes, from the highest
+export const PRIORITIES = [ 'interactive', 'background' ];
+
+export default class Scheduler {
+
+  // create a new scheduler for connection. options can contain:
+  //   - budget: length of a time slice in milliseconds (default 8)
+  constructor(connection, options = {}) {
+    this.connection = connection;
+    this.options = _.defaults({}, options, { budget: 8 });
+    this.queues = _.fromPairs(PRIORITIES.map(priority => [ priority, [] ]));
+    this.running = false;
+  }
+
+  // Query schedules sql, bound to params (see Statement#bindParams), and returns a promise of it's rows,
+  // as arrays of values (see Statement#get). A query that can't return it's first row before it's done
+  // sorting or aggregating runs as a single unbounded slice. options can contain:
+  //   - priority: 'interactive' (default) or 'background'
+  //   - timeout: milliseconds from now after which the query is dropped, or interrupted if running (default Infinity)
+  //   - signal: an AbortSignal; the query is dropped when it's aborted, at the latest by the end of the current slice
+  query(sql, params = null, options = {}) {
+    return this._schedule({ sql, params, rows: [], stmt: null }, options);
+  }
+
+  // Run schedules fn, called with the connection in a single slice of it's own, and returns a promise of it's result.
+  // It's meant for short work that doesn't fit query, as writes made of several statements. Queries suspended in
+  // between slices may or may not see what fn writes. options are as for query.
+  run(fn, options = {}) {
+    return this._schedule({ fn }, options);
+  }
+
+  // Pending returns the number of queries scheduled and not done yet, per priority
+  pending() {
+    return _.mapValues(this.queues, 'length');
+  }
+
+  // _schedule queues task with options and starts running queued tasks, unless already running
+  _schedule(task, options) {
+    const { priority = 'interactive', timeout = Infinity, signal = null } = options;
+    if(this.queues[priority] === undefined) {
+      throw new Error(`unknown priority ${priority}; use one of ${PRIORITIES.join(', ')}`);
+    }
+    return new Promise((resolve, reject) => {
+      this.queues[priority].push({ ...task, priority, deadline: now() + timeout, signal, resolve, reject });
+      if(!this.running) {
+        this.running = true;
+        this._loop();
+      }
+    });
+  }
+
+  // _loop runs a slice of the next task at a time, until none is left
+  async _loop() {
+    try {
+      await null; // let the tasks scheduled along with this one in first
+      for(let task; (task = this._next()) !== undefined; ) {
+        if(!this._slice(task)) {
+          this.queues[task.priority].push(task); // take turns with the other tasks of the same priority
+        }
+        await yieldNow();
+      }
+    } finally {
+      this.running = false;
+    }
+  }
+
+  // _next removes and returns the next task to run, dropping the ones past their deadline or aborted on the way
+  _next() {
+    for(const priority of PRIORITIES) {
+      const queue = this.queues[priority];
+      while(queue.length > 0) {
+        const task = queue.shift();
+        if(task.signal !== null && task.signal.aborted) {
+          this._fail(task, new Error('aborted'));
+        } else if(now() > task.deadline) {
+          this._fail(task, new Error('deadline exceeded'));
+        } else {
+          return task;
+        }
+      }
+    }
+    return undefined;
+  }
+
+  // _slice runs task for a slice, and returns whether it's done (or failed)
+  _slice(task) {
+    const { connection } = this;
+    const bounded = task.deadline !== Infinity;
+    const previous = deadline(connection); // the connection's own timeout, if any
+    try {
+      if(bounded) watch(connection).deadline = Math.min(task.deadline, previous);
+      if(task.fn !== undefined) {
+        task.resolve(task.fn(connection));
+        return true;
+      }
+
+      if(task.stmt === null) {
+        task.stmt = connection.prepare(task.sql);
+        task.stmt.bindParams(task.params);
+      }
+      const start = now();
+      let more;
+      while((more = task.stmt.step())) {
+        task.rows.push(task.stmt.get());
+        if(now() - start >= this.options.budget) break;
+      }
+      if(more) return false;
+
+      task.stmt.finalize();
+      task.resolve(task.rows);
+      return true;
+    } catch(e) {
+      this._fail(task, bounded && now() > task.deadline ? new Error('deadline exceeded') : e);
+      return true;
+    } finally {
+      if(bounded) { // unless it fired in the meantime, in which case it's cleared
+        watch(connection).deadline = previous > now() ? previous : Infinity;
+        settle(connection);
+      }
+    }
+  }
+
+  // _fail rejects task with error, releasing it's statement
+  _fail(task, error) {
+    if(task.stmt && task.stmt.handle !== 0) {
+      try { task.stmt.finalize() } catch(e) { /* the error is reported already */ }
+    }
+    task.reject(error);
+  }
+}
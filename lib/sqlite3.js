@@ -6,6 +6,8 @@
 import * as _ from 'lodash';
 import WASI from './wasi';
 import * as environment from './environment';
+import { emscripten_notify_memory_growth } from './stats';
+import { now } from './statistics';
 
 let loaded = false;
 
@@ -33,49 +35,66 @@ const _stack = proxy();
 export const stack = _stack.proxy;
 
 // export heap (dynamic memory) related exported wasm routines
-// heap = { malloc: ex.malloc, free: ex.free, sqlite3_malloc64: ex.sqlite3_malloc64, sqlite3_free: ex.sqlite3_malloc };
+// heap = { malloc: ex.malloc, free: ex.free, sqlite3_malloc64: ex.sqlite3_malloc64, sqlite3_free: ex.sqlite3_free };
 const _heap = proxy();
 export const heap = _heap.proxy;
 
 // export the wasm runtime memory
-export const memory = new WebAssembly.Memory({ initial: 256, maximum: 1600 }); // maximum 100MiB
+export const MAXIMUM_PAGES = 1600; // maximum 100MiB
+export const memory = new WebAssembly.Memory({ initial: 256, maximum: MAXIMUM_PAGES });
 
 // export the sqlite3 api routines
 const _api = proxy();
 export default _api.proxy;
 
+// phases of load(), as { name, start, end } in milliseconds (see now()), for lib/trace.js
+export const phases = [];
+
+// phase runs fn as the phase name of load() and returns it's result
+const phase = (name, fn) => {
+  const start = now();
+  const result = fn();
+  phases.push({ name, start, end: now() });
+  return result;
+}
+
+// fetch downloads the wasm file at path (synchronously)
+const fetch = path => {
+  const xhr = new XMLHttpRequest();
+  xhr.open("GET", path, false /* synchronous request */);
+  xhr.responseType = 'arraybuffer';
+  xhr.send(null);
+  return xhr.response;
+}
+
 // Load performs the one-time setup by downloading the required wasm file,
 // compiling it and updating the synchornous exports by revoking the gating proxy.
+// The wasm file's bytes (an ArrayBuffer or a view of one) can be passed in directly
+// in place of fn, where there's nothing to download it from (as in Node).
 export function load(fn = _.identity) {
   if(loaded) return;
   
   const wasi = new WASI(memory, {});
-  const path = fn(process.env.WASM_URL);
-  
-  // request to fetch the wasm module
-  const xhr = new XMLHttpRequest();
-  xhr.open("GET", path, false /* synchronous request */);
-  xhr.responseType = 'arraybuffer';
-  xhr.send(null);
+  const bytes = (fn instanceof ArrayBuffer || ArrayBuffer.isView(fn)) ? fn : phase('fetch', () => fetch(fn(process.env.WASM_URL)));
   
-  const module = new WebAssembly.Module(xhr.response); // compile wasm into native format
-  const emscripten = { emscripten_notify_memory_growth: _.noop, memory: memory };
+  const module = phase('compile', () => new WebAssembly.Module(bytes)); // compile wasm into native format
+  const emscripten = { emscripten_notify_memory_growth, memory: memory };
   const imports = _.merge({}, wasi.imports, { env: { ...environment, ...emscripten }});
   
-  const instance = new WebAssembly.Instance(module, imports);
-  wasi.initialize(instance);
+  const instance = phase('instantiate', () => new WebAssembly.Instance(module, imports));
+  phase('initialize', () => wasi.initialize(instance));
   const ex = instance.exports;
   
   loaded = true;
   
   // update the previous exports' bindings
   _.assign(_stack.target, { alloc: ex.stackAlloc, save: ex.stackSave, restore: ex.stackRestore });
-  _.assign(_heap.target, { malloc: ex.malloc, free: ex.free, sqlite3_malloc64: ex.sqlite3_malloc64, sqlite3_free: ex.sqlite3_malloc });
+  _.assign(_heap.target, { malloc: ex.malloc, free: ex.free, sqlite3_malloc64: ex.sqlite3_malloc64, sqlite3_free: ex.sqlite3_free });
   
   // filter sqlite3 routines from exports and cwrap them
   const { cwrap } = require('./runtime');
   const routines = require('./routines.json')
   
-  _.assign(_api.target, _.reduce(routines, (x, { return: ret, args }, name) => { 
-      x[name] = cwrap(ex[name], ret, args); return x }, { /* collector */ }));
+  phase('cwrap', () => _.assign(_api.target, _.reduce(routines, (x, { return: ret, args }, name) => { 
+      x[name] = cwrap(ex[name], ret, args); return x }, { /* collector */ })));
 }
\ No newline at end of file
@@ -1,33 +1,23 @@
 import * as _ from 'lodash';
-import sqlite3, { memory, heap } from './sqlite3';
+import sqlite3 from './sqlite3';
+import { measure, pack } from './packer';
+import { HEAPU8, UTF8Decode, UTF16Decode } from './runtime';
+import { column_int64, column_text, column_text16 } from './column';
+import InternTable from './intern';
+import BlobView from './blob';
+import rowClass from './row';
+import decoder from './decoder';
+import profile from './profile';
+import opcodes from './opcodes';
+import { now, shapeOf } from './statistics';
+import * as allocations from './allocations';
+import * as io from './io';
+import * as trace from './trace';
+import { watch, settle, cancelled, yieldNow } from './progress';
 
 // helper routine that throws an error if rc !== SQLITE_OK
 const _throwIf = rc => { if(rc !== 0) { throw new Error(sqlite3.sqlite3_errstr(rc)) } }
 
-// bind is a helper function to bind val at pos with appropriate type call
-const bind = function(stmt, pos, val) {
-  if(_.isString(val)) {
-    // we use SQLITE_TRANSIENT to bind string; this causes sqlite3 to make a local copy of the string
-    // and is bit easier to deal with for us. But this causes increase overhead of copying (and memory)
-    // @TODO: find a more sustainable alternative to SQLITE_TRANSIENT
-    _throwIf(sqlite3.sqlite3_bind_text(stmt, pos, val, val.length, -1 /* SQLITE_TRANSIENT */));
-  } else if(_.isNumber(val) || _.isBoolean(val)) {
-    let fn = (val === (val | 0)) || _.isBoolean(val)? sqlite3.sqlite3_bind_int : sqlite3.sqlite3_bind_double;
-    _throwIf(fn(stmt, pos, val));
-  } else if(_.isArrayBuffer(val)) {
-    let ptr = heap.malloc(val.byteLength); // allocate a region on heap
-    let mem = new Uint8Array(memory.buffer); // create a view on heap
-    mem.set(val, ptr); // copy the value onto heap
-    let rc = sqlite3.sqlite3_bind_blob(stmt, pos, ptr, val.byteLength, -1 /* SQLITE_TRANSIENT */); // @TODO: fix me
-    heap.free(ptr);
-    _throwIf(rc)
-  } else if (_.isNull(val)) {
-    _throwIf(sqlite3.sqlite3_bind_null(stmt, pos));
-  } else {
-    throw new Error(`unsupported type: ${typeof val}`)
-  }
-}
-
 /*
 ** Statement object represents an individual, compiled query / statement.
 ** It's analogous to sqlite3_stmt in C.
@@ -40,66 +30,259 @@ export default class Statement {
   constructor(connection, ref) { 
     this.connection = connection; 
     this.handle = ref; 
+    this.options = { ...connection.options };
+    this.generation = 0; // incremented every time the current row is invalidated; see BlobView
+    this.elapsed = 0;    // milliseconds spent stepping the current execution, when connection.statistics is set
+    this.returned = 0;   // rows returned by the current execution, when connection.statistics is set
+    this.stepped = false;
+    this.depth = 0;      // number of step, slices, executeMany or withCached calls running it; see lib/cache.js
+    this.executing = false; // whether the current execution returned a row yet
+    this.checked = false;   // whether it was checked for recompiles since the current execution started
+    this.reprepares = 0;    // the SQLITE_STMTSTATUS_REPREPARE counter when last checked; see _recompiled
+    if(allocations.active) allocations.track(this); // sets origin
+  }
+
+  // Configure overrides the options inherited from the connection for this statement only.
+  // See Connection#constructor for the list of supported options.
+  configure(options) {
+    _.assign(this.options, options);
+    this.decode = undefined; // decoders capture the options, so it has to be compiled again
+    return this;
   }
 
-  // BindParams bind arguments to this statement. It resets the statement
-  // clearing any previous binding. If the passed in argument is an array
+  // BindParams bind arguments to this statement. If the passed in argument is an array
   // then it uses anonymous / position-based binding, else it uses named parameters
-  // using object keys as parameter name.
+  // using object keys as parameter name. Parameters not present in params keep their 
+  // previous binding. All the values are packed into wasm memory and bound in a single call.
   bindParams(params) {
-    if(_.isArray(params)) {
-      _.each(params, (param, idx) => bind(this.handle, idx+1, param)) // params are 1-indexed
-    } else if(!_.isNull(params)) {
-      _.each(params, (param, name) => {
-        let idx = sqlite3.sqlite3_bind_parameter_index(this.handle, name);
-        if(idx !== 0) {
-          bind(this.handle, idx, param)
+    if(_.isNull(params) || _.isUndefined(params)) {
+      return;
+    }
+
+    const rows = [params];
+    const layout = this.parameters();
+    const utf16 = this.options.text === 'utf16';
+    const ptr = this.connection.scratch(measure(rows, this.nParam, layout, utf16));
+    pack(ptr, rows, this.nParam, layout, { utf16 });
+    _throwIf(sqlite3.wasm_bind_packed(this.handle, ptr, this.nParam));
+  }
+
+  // Parameters returns a Map of the statement's named parameters (including their prefix,
+  // as in ':name') to their 1-based index. The layout is computed once, on first use.
+  parameters() {
+    if(this.layout === undefined) {
+      let layout = new Map();
+      let n = sqlite3.sqlite3_bind_parameter_count(this.handle);
+      for (let i = 1; i <= n; i += 1) {
+        let name = sqlite3.sqlite3_bind_parameter_name(this.handle, i);
+        if(name !== '') { // anonymous parameters have no name
+          layout.set(name, i);
         }
-      })
+      }
+      this.layout = layout;
+      this.nParam = n;
     }
+    return this.layout;
   }
 
   // Step steps through the statement's execution using sqlite3_step function
   step() {
+    this.generation += 1;
+    const { statistics } = this.connection;
+    const start = statistics ? now() : 0;
+    const prior = allocations.active ? allocations.tag(this.origin || allocations.VDBE) : -1;
+    const outer = io.active ? io.enter(this) : null;
+    const traced = trace.active ? now() : -1;
+    this.depth += 1; // functions called by the step mustn't get it from connection.cache
     let rc = sqlite3.sqlite3_step(this.handle);
+    this.depth -= 1;
+    if(traced >= 0) trace.span('step', traced, { sql: shapeOf(this), rc });
+    if(outer !== null) io.leave(outer);
+    if(prior >= 0) allocations.tag(prior);
+    if(statistics) {
+      this.elapsed += now() - start;
+      this.stepped = true;
+      if(rc === 100 /* SQLITE_ROW */) this.returned += 1; else this._record(rc !== 101 /* SQLITE_DONE */);
+    }
+    if(rc !== 100 /* SQLITE_ROW */) {
+      this.executing = false;
+    } else if(!this.executing) { // sqlite3 recompiles statements on their first step after a schema change
+      this.executing = true;
+      this.checked = false;
+    }
     if(rc !== 100 /* SQLITE_ROW */ && rc !== 101 /* SQLITE_DONE */) {
       throw new Error(sqlite3.sqlite3_errmsg(this.connection.handle));
     }
     return rc === 100? true : false; // wheter the execution returned any rows
   }
 
+  // Slices runs the statement in time slices, returning control to the event loop in between, so that other
+  // work (a newer query superseding this one, say) gets to run. It's an async generator yielding the rows of
+  // every slice, as arrays of values (see get()). A slice ends once it took options.budget milliseconds
+  // (default 8) or ran options.instructions virtual machine instructions (default Infinity), counted every
+  // progressInterval instructions; slices can only end in between rows, so a statement that takes long to
+  // return it's first row (a sort, say) runs in a single slice. Cancellation (see Connection#cancelOn and
+  // Connection#timeout) is also checked in between slices. The statement is reset if it's left half-way.
+  async *slices(options = {}) {
+    const { budget = 8, instructions = Infinity } = options;
+    const state = watch(this.connection);
+    let done = false;
+    state.slices += 1;
+    this.depth += 1;
+    try {
+      for(;;) {
+        const rows = [], start = now(), ran = state.instructions;
+        let more;
+        while((more = this.step())) {
+          rows.push(this.get());
+          if(now() - start >= budget || state.instructions - ran >= instructions) break;
+        }
+        if(!more) done = true;
+        if(rows.length > 0) yield rows;
+        if(done) return;
+
+        await yieldNow();
+        if(cancelled(state)) {
+          throw new Error('interrupted');
+        }
+      }
+    } finally {
+      state.slices -= 1;
+      this.depth -= 1;
+      if(this.connection.handle !== 0) settle(this.connection);
+      if(!done && this.handle !== 0) {
+        this._record();
+        this.generation += 1;
+        sqlite3.sqlite3_reset(this.handle);
+      }
+    }
+  }
+
   // Get returns all the values in current cursor from the 
   // resultset as an array indexed by column position
   get() {
     let results = [];
     let n = sqlite3.sqlite3_data_count(this.handle);
     for (let pos = 0; pos < n; pos += 1) {
-      switch (sqlite3.sqlite3_column_type(this.handle, pos)) {
-        case 1: /* SQLITE_INTEGER */
-        case 2: /* SQLITE_FLOAT */ { 
-          results.push(sqlite3.sqlite3_column_double(this.handle, pos));
-        } break;
-        case 3: /* SQLITE_TEXT */ {
-          results.push(sqlite3.sqlite3_column_text(this.handle, pos));
-        } break;
-        case 4: /* SQLITE_BLOB */ {
-          let size = sqlite3.sqlite3_column_bytes(this.handle, pos);
-          let ptr = sqlite3.sqlite3_column_blob(this.handle, pos);
-          let buf = new Uint8Array(size);
-          
-          // copy values into buffer
-          let heap = new Uint8Array(memory.buffer, ptr, ptr+size)
-          buf.set(heap);
-          results.push(buf);
-        } break;
-        default: /* SQLITE_NULL */ {
-          results.push(null);
-        }
-      }
+      results.push(this.column(pos));
     }
     return results;
   }
 
+  // Column returns the value of the column at pos in the current row
+  column(pos) {
+    switch (sqlite3.sqlite3_column_type(this.handle, pos)) {
+      case 1: /* SQLITE_INTEGER */ return this.integer(pos);
+      case 2: /* SQLITE_FLOAT */ return this.real(pos);
+      case 3: /* SQLITE_TEXT */ return this.text(pos);
+      case 4: /* SQLITE_BLOB */ return this.blob(pos);
+      default: /* SQLITE_NULL */ return null;
+    }
+  }
+
+  // Row returns a lazy accessor for the current row. It's properties are named after the columns
+  // and fetch the column's value only when (and every time) they are read, so columns that are never
+  // read are never copied out of wasm memory. The accessor is only valid until the statement is stepped again.
+  row() {
+    if(!this.checked) this._recompiled();
+    if(this.Row === undefined) {
+      this.Row = rowClass(this.columns()); // built once, and again after the statement is recompiled
+    }
+    return new this.Row(this);
+  }
+
+  // Object returns the current row as a plain object keyed by column name. The first call compiles a 
+  // decoder specialised for the statement's column names and declared types (see lib/decoder.js) that 
+  // builds every row with the same shape and reads each column with a reader picked ahead of time.
+  object() {
+    if(!this.checked) this._recompiled();
+    if(this.decode === undefined) {
+      this.decode = decoder(this);
+    }
+    return this.decode();
+  }
+
+  // Integer reads the column at pos as an integer, honouring the int64 option.
+  // Like real, text and blob below, it doesn't check the column's type.
+  integer(pos) {
+    return this.options.int64? 
+      column_int64(this.handle, pos, this.options.int64) : 
+      sqlite3.sqlite3_column_double(this.handle, pos);
+  }
+
+  // Real reads the column at pos as a floating point number
+  real(pos) {
+    return sqlite3.sqlite3_column_double(this.handle, pos);
+  }
+
+  // Text reads the column at pos as a string, honouring the text and intern options
+  text(pos) {
+    return this.options.text === 'utf16'? 
+      column_text16(this.handle, pos, this.strings()) : 
+      column_text(this.handle, pos, this.strings());
+  }
+
+  // Blob reads the column at pos as a copied Uint8Array, or as a BlobView with the blobs option set to 'view'
+  blob(pos) {
+    let ptr = sqlite3.sqlite3_column_blob(this.handle, pos);
+    let size = sqlite3.sqlite3_column_bytes(this.handle, pos);
+    return this.options.blobs === 'view'? 
+      new BlobView(this, ptr, size) : 
+      HEAPU8().slice(ptr, ptr + size); // copy the value out of wasm memory
+  }
+
+  // Strings returns the statement's intern table for text values, creating it on first use,
+  // or null if the intern option isn't set
+  strings() {
+    if(!this.options.intern) {
+      return null;
+    } else if(this.internTable === undefined) {
+      const { capacity, maxLength } = _.isObject(this.options.intern)? this.options.intern : {};
+      this.internTable = new InternTable(capacity, maxLength, this.options.text === 'utf16'? UTF16Decode : UTF8Decode);
+    }
+    return this.internTable;
+  }
+
+  // Profile resets the statement, binds params (if given) and runs it to completion, discarding the rows, 
+  // and returns a Profile (see lib/profile.js) joining it's query plan with the number of times each loop ran 
+  // and the rows it visited, against the planner's estimates, plus the wall time spent. String(profile) renders
+  // it as a tree. The statement is left reset, with it's bindings in place.
+  profile(params) {
+    return profile(this, params);
+  }
+
+  // Opcodes returns the number of times each VDBE opcode was executed by this statement (and any other
+  // statement with the same SQL text) and the time spent in it, as of the last time it was reset or finalized.
+  // Only available with sqlite3.profile.wasm; see lib/opcodes.js
+  opcodes() {
+    return opcodes(sqlite3.sqlite3_sql(this.handle));
+  }
+
+  // _recompiled drops the row class and decoder if sqlite3 recompiled the statement since they were built
+  // (after a schema change, say), as it's resultset may have changed. It runs once per execution, on the
+  // first call to row() or object(). connection.statistics resets the counter and accounts for it.
+  _recompiled() {
+    const n = sqlite3.sqlite3_stmt_status(this.handle, 5 /* SQLITE_STMTSTATUS_REPREPARE */, 0);
+    if(n !== this.reprepares) {
+      this.reprepares = n;
+      this.Row = undefined;
+      this.decode = undefined;
+    }
+    this.checked = true;
+  }
+
+  // _record hands the execution in progress, if any, over to connection.statistics, and ends it. Executions end
+  // when step() is done or fails, or when the statement is reset or finalized half-way.
+  _record(failed = false) {
+    if(this.stepped && this.connection.statistics) {
+      this.connection.statistics.record(this, this.elapsed, this.returned, 1, failed);
+    }
+    this.elapsed = 0;
+    this.returned = 0;
+    this.stepped = false;
+    this.executing = false;
+  }
+
   // Columns returns an array of column names in the resultset
   columns() {
     let results = [];
@@ -113,12 +296,18 @@ export default class Statement {
   // Reset resets a statement, so that it's parameters can be bound to new values.
   // It also clears all previous bindings using sqlite3_clear_bindings
   reset() {
+    this._record();
+    this.generation += 1;
     _throwIf(sqlite3.sqlite3_reset(this.handle))
     _throwIf(sqlite3.sqlite3_clear_bindings(this.handle))
   }
 
   // Finalize destroys the stmt and unsets the reference making it invalid
   finalize() {
+    this._record();
+    allocations.untrack(this);
+    if(this.connection.zombie) this.connection._reap(this.handle);
+    this.generation += 1;
     let rc = sqlite3.sqlite3_finalize(this.handle);
     this.handle = 0;
     if(rc !== 0) {
@@ -0,0 +1,116 @@
+/*
+** Statistics accumulates the executions of a connection's statements per
+** query shape, keying them by their normalized sql (sqlite3_normalized_sql,
+** where literals are replaced by ?), so that statements differing only in
+** their values share an entry. It keeps the latency distribution and the
+** sqlite3_stmt_status counters of every shape, plus a log of the slowest
+** executions. It's owned by a Connection and is available as
+** connection.statistics when the statistics option is set.
+*/
+
+import * as _ from 'lodash';
+import sqlite3, { memory } from './sqlite3';
+
+// now returns a high-resolution timestamp in milliseconds
+export const now = () => (typeof performance !== 'undefined'? performance.now() : Date.now());
+
+// number of sqlite3_stmt_status counters read by wasm_stmt_status; see src/wasm_stmt_status.c
+const COUNTERS = 7;
+
+// latencies are kept in a histogram of buckets growing by 2^(1/STEPS), starting at 1 microsecond
+const STEPS = 8;
+export const BUCKETS = STEPS * 40;
+
+// bucket returns the index of the histogram bucket for a latency in milliseconds
+export const bucket = ms => _.clamp(Math.ceil(Math.log2(ms * 1000) * STEPS), 0, BUCKETS - 1);
+
+// percentile returns the upper bound, in milliseconds, of the bucket the p-th quantile falls into
+export const percentile = (histogram, total, p) => {
+  let rank = Math.ceil(total * p), seen = 0;
+  for(let i = 0; i < BUCKETS; i++) {
+    seen += histogram[i];
+    if(seen >= rank) return Math.pow(2, i / STEPS) / 1000;
+  }
+  return 0;
+}
+
+// shapeOf returns the query shape of stmt, it's normalized sql, computing it on first use
+export const shapeOf = stmt => {
+  if(stmt.shape === undefined) {
+    stmt.shape = sqlite3.sqlite3_normalized_sql(stmt.handle) || sqlite3.sqlite3_sql(stmt.handle);
+  }
+  return stmt.shape;
+}
+
+export default class Statistics {
+
+  // create a new registry for the statements of connection. options can contain:
+  //   - slowThreshold: executions taking at least this many milliseconds are logged (default Infinity)
+  //   - slowLogSize: number of slow executions kept, the oldest being dropped first (default 100)
+  constructor(connection, options = {}) {
+    this.connection = connection;
+    this.options = _.defaults({}, options, { slowThreshold: Infinity, slowLogSize: 100 });
+    this.shapes = new Map();
+    this.log = [];
+  }
+
+  // Record accounts for n executions of stmt (one, unless run by executeMany) that took time milliseconds
+  // in total and returned rows rows. failed is set when the execution ended in an error.
+  record(stmt, time, rows, n = 1, failed = false) {
+    let shape = this.shapes.get(shapeOf(stmt));
+    if(shape === undefined) {
+      shape = {
+        sql: stmt.shape, executions: 0, errors: 0, rows: 0, time: 0, max: 0, histogram: new Uint32Array(BUCKETS),
+        fullscanSteps: 0, sorts: 0, autoindexes: 0, vmSteps: 0, reprepares: 0, memory: 0,
+      };
+      this.shapes.set(stmt.shape, shape);
+    }
+
+    shape.executions += n;
+    shape.errors += failed ? 1 : 0;
+    shape.rows += rows;
+    shape.time += time;
+    shape.max = Math.max(shape.max, time / n);
+    shape.histogram[bucket(time / n)] += n;
+
+    // the counters are reset after every read, so they only cover the executions being recorded
+    const ptr = this.connection.scratch(COUNTERS * 4);
+    sqlite3.wasm_stmt_status(stmt.handle, ptr, 1);
+    const [ fullscanSteps, sorts, autoindexes, vmSteps, reprepares, /* runs */, used ] = new Int32Array(memory.buffer, ptr, COUNTERS);
+    shape.fullscanSteps += fullscanSteps;
+    shape.sorts += sorts;
+    shape.autoindexes += autoindexes;
+    shape.vmSteps += vmSteps;
+    shape.reprepares += reprepares;
+    stmt.reprepares -= reprepares; // keeps recompiles visible to Statement#_recompiled
+    shape.memory = Math.max(shape.memory, used);
+
+    if(time >= this.options.slowThreshold) {
+      this.log.push({ sql: sqlite3.sqlite3_sql(stmt.handle), shape: stmt.shape, time, rows, executions: n, at: Date.now() });
+      if(this.log.length > this.options.slowLogSize) this.log.shift();
+    }
+  }
+
+  // Entries returns a snapshot of every query shape, with the most time consuming first. Each entry has
+  // the normalized sql, executions, errors, rows returned, total / mean / max / p95 latency in milliseconds
+  // (p95 comes from a histogram and is accurate to within 9%) and the sum of the fullscanSteps, sorts,
+  // autoindexes, vmSteps and reprepares counters over all executions, as well as the most memory used.
+  entries() {
+    return _.orderBy([ ...this.shapes.values() ].map(({ histogram, ...shape }) => ({
+      ...shape,
+      mean: shape.executions > 0 ? shape.time / shape.executions : 0,
+      p95: Math.min(percentile(histogram, shape.executions, 0.95), shape.max),
+    })), 'time', 'desc');
+  }
+
+  // Slow returns the logged slow executions, oldest first, with their sql as prepared (before normalization)
+  slow() {
+    return [ ...this.log ];
+  }
+
+  // Reset forgets all shapes and slow executions
+  reset() {
+    this.shapes.clear();
+    this.log = [];
+  }
+}
@@ -0,0 +1,81 @@
+/*
+** stats.js reports on memory use: sqlite3's own counters, globally and per
+** connection (see src/wasm_status.c), and the size of the wasm memory along
+** with every time it grew, so that running into the memory's maximum can be
+** seen coming.
+*/
+
+import * as _ from 'lodash';
+import sqlite3, { memory, stack, MAXIMUM_PAGES } from './sqlite3'; // delibrate circular imports
+
+// size of a wasm memory page in bytes
+const PAGE = 65536;
+
+// most recent memory growth events kept
+const EVENTS = 64;
+
+// memory growth events, oldest first, and their total number
+const growth = { count: 0, events: [] };
+
+// whether sqlite3 collects memory statistics; see memoryStatus in lib/index.js
+let enabled = false;
+export function setEnabled(value) { enabled = value }
+
+// emscripten_notify_memory_growth is called by the wasm module every time it grows the memory
+export function emscripten_notify_memory_growth() {
+  growth.count += 1;
+  growth.events.push({ at: Date.now(), pages: memory.buffer.byteLength / PAGE });
+  if(growth.events.length > EVENTS) growth.events.shift();
+}
+
+// read calls fn with n counter pairs laid out in an array of Type allocated on the stack,
+// and returns them as [ current, highwater ] pairs of numbers
+const read = (n, Type, fn) => {
+  const esp = stack.save();
+  try {
+    const ptr = stack.alloc(n * 2 * Type.BYTES_PER_ELEMENT);
+    fn(ptr);
+    const values = Array.from(new Type(memory.buffer, ptr, n * 2), Number);
+    return _.chunk(values, 2);
+  } finally {
+    stack.restore(esp);
+  }
+}
+
+// Stats returns the global memory statistics. heap (bytes allocated by sqlite3), mallocs (outstanding allocations),
+// largestAllocation and pageCache are only collected while memory status is on (see memoryStatus), as reported by
+// memstatus. wasm describes the wasm memory: it's size in pages and bytes, the maximum it can grow to and the
+// number of times it grew, along with the most recent of those. Set reset to reset the highwater marks.
+export default function stats(reset = false) {
+  const [ heap, mallocs, largest, pageCache, overflow, pageSize ] = read(6, BigInt64Array, ptr => sqlite3.wasm_status(ptr, reset ? 1 : 0));
+  const pages = memory.buffer.byteLength / PAGE;
+  return {
+    memstatus: enabled,
+    heap: { current: heap[0], highwater: heap[1] },
+    mallocs: { current: mallocs[0], highwater: mallocs[1] },
+    largestAllocation: largest[1],
+    pageCache: {
+      used: pageCache[0], highwater: pageCache[1],           // pages taken from the page cache memory
+      overflow: overflow[0], overflowHighwater: overflow[1], // bytes of pages that didn't fit there
+      largest: pageSize[1],
+    },
+    wasm: {
+      pages, bytes: pages * PAGE, maximumPages: MAXIMUM_PAGES,
+      growth: { count: growth.count, events: [ ...growth.events ] },
+    },
+  };
+}
+
+// ConnectionStats returns the memory statistics of the connection: lookaside (slots in use, highwater, hits and
+// misses, for want of a large enough or of a free slot), pager cache (bytes used, hits, misses, writes and spills)
+// and the bytes used by the schema and by prepared statements. Set reset to reset the highwater marks and counters.
+export function connectionStats(connection, reset = false) {
+  const [ used, hit, missSize, missFull, cache, cacheHit, cacheMiss, cacheWrite, cacheSpill, schema, statements ] =
+    read(11, Int32Array, ptr => sqlite3.wasm_db_status(connection.handle, ptr, reset ? 1 : 0));
+  return {
+    lookaside: { used: used[0], highwater: used[1], hits: hit[1], missesSize: missSize[1], missesFull: missFull[1] },
+    cache: { used: cache[0], hits: cacheHit[0], misses: cacheMiss[0], writes: cacheWrite[0], spills: cacheSpill[0] },
+    schema: schema[0],
+    statements: statements[0],
+  };
+}
@@ -0,0 +1,128 @@
+/*
+** trace.js records a timeline of what the library does, in the Trace Event
+** format loaded by Perfetto and chrome://tracing: the phases of load(), every
+** prepare and step, the statements sqlite3 runs (sqlite3_trace_v2, see
+** src/wasm_trace.c), the requests of the http vfs (see lib/io.js) and,
+** optionally, every call into wasm. Each layer has a thread of it's own in
+** the timeline, so that spans nest properly.
+*/
+
+import * as _ from 'lodash';
+import sqlite3, { memory, phases } from './sqlite3'; // delibrate circular imports
+import { UTF8ToString } from './runtime';
+import { now } from './statistics';
+import * as io from './io';
+
+// threads of the timeline, one per layer; requests of the http vfs are on HTTP (see lib/io.js)
+export const BINDING = 1, VDBE = 2, HTTP = 3, CALLS = 4;
+const THREADS = { [BINDING]: 'binding', [VDBE]: 'sqlite3 statements', [HTTP]: 'http vfs', [CALLS]: 'wasm calls' };
+
+// whether a trace is being recorded
+export let active = false;
+
+// the trace being recorded, the most events kept and how many were dropped past that
+let events = [], limit = 0, dropped = 0;
+
+// connections traced, statements running (and when they started) and the api routines wrapped by the calls option
+let connections = new Set();
+const running = new Map();
+let wrapped = null;
+
+// whether io was already enabled when the trace started, to leave it as it was
+let accounting = false;
+
+// event adds a complete event (ph X) for a span that started at start and ends now, in milliseconds
+const event = (tid, name, cat, start, args) => {
+  if(events.length >= limit) {
+    dropped += 1;
+    return;
+  }
+  const end = now();
+  events.push({ name, cat, ph: 'X', ts: start * 1000, dur: (end - start) * 1000, pid: 1, tid, args });
+}
+
+// Span records a span of the binding layer, name, that started at start (see now()) and ends now
+export function span(name, start, args) {
+  event(BINDING, name, 'binding', start, args);
+}
+
+// Connect starts tracing the statements connection runs
+export function connect(connection) {
+  connections.forEach(c => { if(c.handle === 0) connections.delete(c) }); // forget closed connections
+  connections.add(connection);
+  sqlite3.wasm_trace(connection.handle, 1);
+}
+
+// wasm_trace_statement provides implementation of
+// C extern function with similar name defined in src/os_wasm.h
+// A statement is reported when it starts, with it's sql, and when it ends.
+export function wasm_trace_statement(eEvent, stmt, zSql) {
+  if(!active) return;
+  if(eEvent === 0) {
+    running.set(stmt, { start: now(), sql: UTF8ToString(new Uint8Array(memory.buffer), zSql) });
+  } else if(running.has(stmt)) {
+    const { start, sql } = running.get(stmt);
+    running.delete(stmt);
+    event(VDBE, _.truncate(sql, { length: 64 }), 'sqlite3', start, { sql });
+  }
+}
+
+// Start starts recording a trace, discarding any previous one. Connections opened from now on are traced;
+// pass the ones already open in options.connections. options can contain:
+//   - connections: connections already open to trace
+//   - calls: true to record every call into wasm, which adds considerably to it's cost (default false)
+//   - limit: most events recorded, later ones being dropped (default 1000000)
+export function start(options = {}) {
+  if(active) stop();
+  events = [];
+  dropped = 0;
+  limit = options.limit || 1000000;
+  active = true;
+
+  (options.connections || []).forEach(connect);
+
+  accounting = io.active;
+  io.enable({ trace: true, traceLimit: limit });
+
+  if(options.calls) {
+    wrapped = _.pickBy(_.fromPairs(Object.keys(sqlite3).map(name => [ name, sqlite3[name] ])), _.isFunction);
+    _.forEach(wrapped, (fn, name) => {
+      sqlite3[name] = function() {
+        const start = now();
+        try {
+          return fn.apply(this, arguments);
+        } finally {
+          event(CALLS, name, 'wasm', start);
+        }
+      };
+    });
+  }
+}
+
+// Stop stops recording and returns the trace as a Trace Event JSON object, to be saved with JSON.stringify.
+// It includes the phases of load(), whenever it ran.
+export function stop() {
+  if(!active) {
+    throw new Error('no trace is being recorded');
+  }
+  active = false;
+
+  if(wrapped !== null) {
+    _.assign(sqlite3, wrapped);
+    wrapped = null;
+  }
+  connections.forEach(c => { if(c.handle !== 0) sqlite3.wasm_trace(c.handle, 0) });
+  connections = new Set();
+  running.clear();
+
+  const requests = io.traceEvents().map(e => ({ ...e, tid: HTTP }));
+  if(accounting) io.enable({ trace: false }); else io.disable();
+
+  const metadata = _.map(THREADS, (name, tid) => ({ name: 'thread_name', ph: 'M', pid: 1, tid: Number(tid), args: { name } }));
+  const loading = phases.map(({ name, start, end }) => ({ name: `load: ${name}`, cat: 'load', ph: 'X', ts: start * 1000, dur: (end - start) * 1000, pid: 1, tid: BINDING }));
+  return {
+    traceEvents: [ ...metadata, ...loading, ..._.sortBy([ ...events, ...requests ], 'ts') ],
+    displayTimeUnit: 'ms',
+    otherData: { dropped },
+  };
+}
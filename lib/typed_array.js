@@ -0,0 +1,158 @@
+/*
+** TypedArrayTable exposes columnar Javascript arrays as a read-only virtual
+** table through the typed_array extension (see ext/misc/typed_array.c), so that
+** they can be queried and bulk-loaded into other tables without binding values
+** row by row.
+*/
+
+import * as _ from 'lodash';
+import sqlite3, { memory, stack, heap } from './sqlite3';
+import { lengthBytesUTF8, stringToUTF8 } from './runtime';
+
+// column types; must be kept in sync with ext/misc/typed_array.c
+const INT32 = 1, INT64 = 2, FLOAT64 = 3, TEXT = 4, BLOB = 5;
+
+// size of a typed_array_column descriptor in bytes
+const DESCRIPTOR = 16;
+
+// int64 returns the bigint values, checking they fit in 64-bit signed integers
+const int64 = values => {
+  const i = _.findIndex(values, v => BigInt.asIntN(64, v) !== v);
+  if(i >= 0) {
+    throw new RangeError(`typed array value ${values[i]} at ${i} is out of the range of 64-bit integers`);
+  }
+  return values;
+}
+
+export default class TypedArrayTable {
+
+  // register columns (an object of column name -> array) as name and create the virtual table
+  // temp.name over them. Float64Array, Int32Array and BigInt64Array columns that already live in
+  // wasm memory are used in place; other typed arrays, arrays of numbers (as doubles), of bigints,
+  // of strings and of Uint8Arrays are copied into wasm memory owned by the table. BigUint64Array
+  // and bigint values must fit in 64-bit signed integers. null and undefined strings or Uint8Arrays
+  // read as NULL.
+  constructor(connection, name, columns) {
+    if(!/^[A-Za-z_][A-Za-z0-9_]*$/.test(name)) {
+      throw new Error(`invalid typed array name: ${name}`);
+    }
+
+    this.connection = connection;
+    this.name = name;
+    this.owned = []; // pointers to memory allocated for copies of the columns
+
+    const names = _.keys(columns);
+    const length = names.length > 0 ? columns[names[0]].length : 0;
+    if(names.length === 0 || _.some(names, n => columns[n].length !== length)) {
+      throw new Error('typed array columns must be non-empty and of equal length');
+    }
+
+    try {
+      const descriptors = names.map(n => this._column(columns[n]));
+      this._register(names, descriptors, length);
+      connection.exec(`CREATE VIRTUAL TABLE temp."${name}" USING typed_array(${name})`);
+    } catch(e) {
+      this._free();
+      throw e;
+    }
+  }
+
+  // _alloc allocates size bytes of wasm memory owned by the table
+  _alloc(size) {
+    const ptr = heap.malloc(Math.max(size, 1));
+    this.owned.push(ptr);
+    return ptr;
+  }
+
+  // _copy copies the typed array values into memory owned by the table and returns the pointer
+  _copy(values, Type) {
+    const ptr = this._alloc(values.length * Type.BYTES_PER_ELEMENT);
+    new Type(memory.buffer, ptr, values.length).set(values);
+    return ptr;
+  }
+
+  // _column returns the [ type, data, offsets ] descriptor of the column values
+  _column(values) {
+    const inPlace = v => v.buffer === memory.buffer;
+
+    if(values instanceof Float64Array) return [ FLOAT64, inPlace(values) ? values.byteOffset : this._copy(values, Float64Array), 0 ];
+    if(values instanceof Int32Array) return [ INT32, inPlace(values) ? values.byteOffset : this._copy(values, Int32Array), 0 ];
+    if(values instanceof BigInt64Array) return [ INT64, inPlace(values) ? values.byteOffset : this._copy(values, BigInt64Array), 0 ];
+    if(values instanceof BigUint64Array) return [ INT64, this._copy(int64(values), BigInt64Array), 0 ];
+    if(values instanceof Float32Array || values instanceof Uint32Array) return [ FLOAT64, this._copy(values, Float64Array), 0 ];
+    if(ArrayBuffer.isView(values)) return [ INT32, this._copy(values, Int32Array), 0 ]; // smaller integer arrays
+
+    if(_.every(values, _.isNumber)) return [ FLOAT64, this._copy(values, Float64Array), 0 ];
+    if(_.every(values, v => typeof v === 'bigint')) return [ INT64, this._copy(int64(values), BigInt64Array), 0 ];
+
+    // NULL values of TEXT and BLOB columns have their offset stored negated, as ~offset
+    const isNull = v => v === null || v === undefined;
+    if(_.every(values, v => _.isString(v) || isNull(v))) {
+      let size = _.sumBy(values, v => v ? lengthBytesUTF8(v) : 0);
+      let data = this._alloc(size + 1 /* stringToUTF8 always writes a terminator */), off = 0;
+      let offsets = new Int32Array(values.length + 1);
+      let mem = new Uint8Array(memory.buffer);
+      values.forEach((v, i) => {
+        offsets[i] = isNull(v) ? ~off : off;
+        if(v) off += stringToUTF8(v, mem, data + off, size - off + 1);
+      });
+      offsets[values.length] = off;
+      return [ TEXT, data, this._copy(offsets, Int32Array) ];
+    }
+    if(_.every(values, v => v instanceof Uint8Array || isNull(v))) {
+      let size = _.sumBy(values, v => isNull(v) ? 0 : v.byteLength);
+      let data = this._alloc(size), off = 0;
+      let offsets = new Int32Array(values.length + 1);
+      values.forEach((v, i) => {
+        offsets[i] = isNull(v) ? ~off : off;
+        if(isNull(v)) return;
+        new Uint8Array(memory.buffer).set(v, data + off);
+        off += v.byteLength;
+      });
+      offsets[values.length] = off;
+      return [ BLOB, data, this._copy(offsets, Int32Array) ];
+    }
+    throw new TypeError('unsupported typed array column; expected a typed array, or an array of numbers, bigints, strings or Uint8Arrays');
+  }
+
+  // _register describes the columns to the typed_array extension
+  _register(names, descriptors, length) {
+    let esp = stack.save();
+    try {
+      const nameSize = _.sumBy(names, n => lengthBytesUTF8(n) + 1);
+      const ptr = stack.alloc(names.length * DESCRIPTOR + nameSize);
+      const words = new Int32Array(memory.buffer, ptr, names.length * 4);
+      const mem = new Uint8Array(memory.buffer);
+
+      let z = ptr + names.length * DESCRIPTOR;
+      names.forEach((n, i) => {
+        const [ type, data, offsets ] = descriptors[i];
+        words.set([ z, type, data, offsets ], i * 4);
+        z += stringToUTF8(n, mem, z, lengthBytesUTF8(n) + 1) + 1;
+      });
+
+      const rc = sqlite3.sqlite3_typed_array_register(this.name, length, names.length, ptr);
+      if(rc !== 0) { // !== SQLITE_OK
+        throw new Error(`failed to register typed array: ${sqlite3.sqlite3_errstr(rc)}`);
+      }
+    } finally {
+      stack.restore(esp);
+    }
+  }
+
+  // _free releases memory owned by the table
+  _free() {
+    this.owned.forEach(ptr => heap.free(ptr));
+    this.owned = [];
+  }
+
+  // Release drops the virtual table, unregisters the arrays and frees any copies of them.
+  // Arrays used in place remain owned by the caller.
+  release() {
+    if(this.connection.handle) {
+      this.connection.exec(`DROP TABLE IF EXISTS temp."${this.name}"`);
+    }
+    sqlite3.sqlite3_typed_array_unregister(this.name);
+    this._free();
+  }
+}
@@ -0,0 +1,282 @@
+/*
+** vtab.js keeps the Javascript implementations of virtual table modules
+** (see Connection#module) and provides the environment imports src/wasm_vtab.c
+** calls into to plan and scan their tables.
+*/
+
+import * as _ from 'lodash';
+import { memory, heap } from './sqlite3'; // delibrate circular imports
+import { NULL, measure, pack, store, unpack } from './packer';
+import { UTF8ToString } from './runtime';
+
+// constraint operators (SQLITE_INDEX_CONSTRAINT_*) the default plan pushes down
+export const EQ = 2, GT = 4, LE = 8, LT = 16, GE = 32, NE = 68;
+
+// integers per constraint in the arrays handed over by wasm_vtab_best_index; see src/wasm_vtab.c
+const CONSTRAINT_SIZE = 6;
+
+// registered modules, keyed by the id handed over to wasm_create_module
+const modules = new Map();
+let nextModule = 1;
+
+// table instances, keyed by the id kept in wasm_vtab
+const tables = new Map();
+let nextTable = 1;
+
+// iterators of open scans, keyed by the id kept in wasm_vtab_cursor
+const cursors = new Map();
+let nextCursor = 1;
+
+// Register adds impl to the registry and returns the id that identifies it to C. Every scan iterates
+// over rows again, so iterables like a Set or a Map are read live; only one-shot iterators (a generator,
+// map.values()), which are their own iterator, are read into an array right away.
+export function register(impl) {
+  if(!impl.bestIndex && !_.isArray(impl.rows) && !_.isFunction(impl.rows)) {
+    if(impl.rows === null || impl.rows === undefined || !_.isFunction(impl.rows[Symbol.iterator])) {
+      throw new Error('rows must be an array, an iterable or a function');
+    }
+    if(impl.rows[Symbol.iterator]() === impl.rows) { // would be exhausted after the first scan
+      impl = Object.assign(Object.create(impl), { rows: Array.from(impl.rows) }); // keeps the methods of impl
+    }
+  }
+  const id = nextModule++;
+  modules.set(id, impl);
+  return id;
+}
+
+// fail packs the message of the error e into the slot at ptr and returns a non-zero code
+const fail = (ptr, e) => {
+  store(ptr, String(e && e.message || e));
+  return 1; // SQLITE_ERROR
+}
+
+// affinity returns the affinity of a column with the given declared type, following sqlite3's rules
+// for determining column affinity (https://www.sqlite.org/datatype3.html)
+const affinity = decltype => {
+  const t = decltype.toUpperCase();
+  if(t.includes('INT')) return 'integer';
+  if(t.includes('CHAR') || t.includes('CLOB') || t.includes('TEXT')) return 'text';
+  if(t.includes('BLOB') || t === '') return 'blob';
+  if(t.includes('REAL') || t.includes('FLOA') || t.includes('DOUB')) return 'real';
+  return 'numeric';
+}
+
+// words that end the declared type of a column definition, and those that start a table constraint
+const CONSTRAINT = /^(CONSTRAINT|PRIMARY|NOT|NULL|UNIQUE|CHECK|DEFAULT|COLLATE|REFERENCES|GENERATED|AS|HIDDEN)$/i;
+const TABLE_CONSTRAINT = /^(CONSTRAINT|PRIMARY|UNIQUE|CHECK|FOREIGN)$/i;
+
+// affinities returns the affinity of every column declared by schema, a CREATE TABLE statement
+const affinities = schema => {
+  const body = schema.slice(schema.indexOf('(') + 1, schema.lastIndexOf(')'));
+  const defs = [];
+  let depth = 0, start = 0;
+  for(let i = 0; i < body.length; i++) { // split at top-level commas; quoted names with commas are uncommon enough
+    if(body[i] === '(') depth++;
+    else if(body[i] === ')') depth--;
+    else if(body[i] === ',' && depth === 0) { defs.push(body.slice(start, i)); start = i + 1 }
+  }
+  defs.push(body.slice(start));
+
+  return defs.map(def => def.match(/"[^"]*"|`[^`]*`|\[[^\]]*\]|'[^']*'|\([^)]*\)|[^\s(]+/g) || [])
+    .filter(tokens => tokens.length > 0 && !TABLE_CONSTRAINT.test(tokens[0]))
+    .map(([ _name, ...rest ]) => {
+      const type = _.takeWhile(rest, t => !CONSTRAINT.test(t) && !/^['"(]/.test(t));
+      return affinity(type.join(' '));
+    });
+}
+
+// compare returns the result of comparing the value of a column with the right-hand side of a constraint,
+// or undefined when Javascript can't tell how sqlite3 would compare them (so the row must be kept).
+// sqlite3 applies the column's affinity to the right-hand side: a TEXT column turns numbers into text,
+// which orders after any number, and a numeric one turns text into numbers. So numbers are only compared
+// in columns of INTEGER, REAL or NUMERIC affinity (or none, which converts nothing) and strings in
+// columns of TEXT affinity (or none). Comparisons with NULL are never true.
+const compare = (val, { op, value, binary }, kind) => {
+  if(val === null || val === undefined || value === null) return false;
+
+  const numeric = x => typeof x === 'number' || typeof x === 'bigint';
+  if(numeric(val) && numeric(value) && kind !== 'text') {
+    switch(op) {
+      case EQ: return val == value;
+      case NE: return val != value;
+      case GT: return val > value;
+      case GE: return val >= value;
+      case LT: return val < value;
+      case LE: return val <= value;
+    }
+  }
+
+  // Javascript orders strings by UTF-16 code units rather than by UTF-8 bytes, so only test equality
+  if(_.isString(val) && _.isString(value) && binary && (kind === 'text' || kind === 'blob')) {
+    if(op === EQ) return val === value;
+    if(op === NE) return val !== value;
+  }
+}
+
+// plan is the default query plan. It pushes every usable comparison on a table column down to
+// rows() and drops rows that don't match before they are packed. sqlite3 still double checks
+// every row, so pruning only needs to be conservative, not exact.
+const plan = (impl, { constraints }) => {
+  let used = [], rows = _.isArray(impl.rows) ? impl.rows.length : 1e6;
+  constraints.forEach((c, i) => {
+    if(c.usable && c.column >= 0 && [ EQ, GT, LE, LT, GE, NE ].includes(c.op)) {
+      used.push(i);
+      rows /= c.op === EQ ? 10 : (c.op === NE ? 1 : 3);
+    }
+  });
+
+  let idxStr = JSON.stringify(used.map(i => [ constraints[i].column, constraints[i].op, constraints[i].binary ]));
+  return { args: used, idxStr, cost: rows, rows: Math.max(Math.ceil(rows), 1) };
+}
+
+// scan is the default filter. It passes the pushed down constraints on to rows() and yields the rows
+// that might match them, given the affinities of table's columns.
+function* scan({ impl, columns }, args, idxStr) {
+  const constraints = JSON.parse(idxStr || '[]').map(([ column, op, binary ], i) => ({ column, op, binary, value: args[i] }));
+  const rows = _.isFunction(impl.rows) ? impl.rows(constraints) : impl.rows;
+  for(const row of rows) {
+    if(constraints.every(c => compare(row[c.column], c, columns[c.column]) !== false)) yield row;
+  }
+}
+
+// wasm_vtab_connect provides implementation of
+// C extern function with similar name defined in src/os_wasm.h
+// It creates a table instance of module id and packs the statement declaring it's schema at out.
+export function wasm_vtab_connect(id, argc, argv, pTable, out) {
+  try {
+    const impl = modules.get(id);
+    const words = new Int32Array(memory.buffer, argv, argc);
+    const mem = new Uint8Array(memory.buffer);
+    const args = Array.from(words, ptr => UTF8ToString(mem, ptr)).slice(3); // skip module, database and table names
+
+    const schema = _.isFunction(impl.schema) ? impl.schema(args) : impl.schema;
+    const table = nextTable++;
+    tables.set(table, { impl, columns: impl.bestIndex ? [] : affinities(String(schema)) });
+    new Int32Array(memory.buffer, pTable, 1)[0] = table;
+    store(out, String(schema));
+    return 0;
+  } catch(e) {
+    return fail(out, e);
+  }
+}
+
+// wasm_vtab_disconnect provides implementation of
+// C extern function with similar name defined in src/os_wasm.h
+export function wasm_vtab_disconnect(table) {
+  tables.delete(table);
+}
+
+// wasm_vtab_best_index provides implementation of
+// C extern function with similar name defined in src/os_wasm.h
+// It picks the plan for a scan of table, using the module's bestIndex() if it has one and the
+// default plan otherwise, and writes it back into the arrays and wasm_index_plan passed in from C.
+// bestIndex({ constraints: [{ column, op, usable, binary }], orderBy: [{ column, desc }] }) returns null when 
+// there's no usable plan, or { args, omit, idxNum, idxStr, orderByConsumed, cost, rows } where args lists the
+// indexes of the constraints whose values are passed on to filter() (in order) and omit those sqlite3 needn't check.
+export function wasm_vtab_best_index(table, nCons, aCons, nOrderBy, aOrderBy, pPlan, err) {
+  try {
+    const { impl } = tables.get(table);
+    const cons = new Int32Array(memory.buffer, aCons, nCons * CONSTRAINT_SIZE);
+    const order = new Int32Array(memory.buffer, aOrderBy, nOrderBy * 2);
+
+    const info = {
+      constraints: _.times(nCons, i => {
+        let k = i * CONSTRAINT_SIZE;
+        return { column: cons[k], op: cons[k + 1], usable: cons[k + 2] !== 0, binary: cons[k + 3] !== 0 };
+      }),
+      orderBy: _.times(nOrderBy, i => ({ column: order[2 * i], desc: order[2 * i + 1] !== 0 })),
+    };
+
+    const result = impl.bestIndex ? impl.bestIndex(info) : plan(impl, info);
+    if(result === null || result === undefined) {
+      return 19; // SQLITE_CONSTRAINT; no usable plan
+    }
+
+    const { args = [], omit = [], idxNum = 0, idxStr = null, orderByConsumed = false, cost = 1e6, rows = 1e6 } = result;
+    if(idxStr !== null) store(pPlan + 24, String(idxStr)); // before creating any view, as malloc might grow the memory
+
+    const out = new Int32Array(memory.buffer, aCons, nCons * CONSTRAINT_SIZE);
+    args.forEach((c, i) => { out[c * CONSTRAINT_SIZE + 4] = i + 1 });
+    omit.forEach(c => { out[c * CONSTRAINT_SIZE + 5] = 1 });
+
+    const view = new DataView(memory.buffer);
+    view.setInt32(pPlan, idxNum, true);
+    view.setInt32(pPlan + 4, orderByConsumed ? 1 : 0, true);
+    view.setFloat64(pPlan + 8, cost, true);
+    view.setFloat64(pPlan + 16, rows, true);
+    return 0;
+  } catch(e) {
+    return fail(err, e);
+  }
+}
+
+// wasm_vtab_filter provides implementation of
+// C extern function with similar name defined in src/os_wasm.h
+// It starts a new scan of table, passing the constraint values packed at argv on to the module's
+// filter(args, idxNum, idxStr) (or the default filter), and keeps the resulting iterator for the cursor.
+export function wasm_vtab_filter(table, pCursor, idxNum, idxStr, argc, argv, err) {
+  try {
+    const entry = tables.get(table), { impl } = entry;
+    const args = unpack(argv, argc);
+    const str = idxStr !== 0 ? UTF8ToString(new Uint8Array(memory.buffer), idxStr) : null;
+
+    const rows = impl.bestIndex ? impl.filter(args, idxNum, str) : scan(entry, args, str);
+    const slot = new Int32Array(memory.buffer, pCursor, 1);
+    if(slot[0] === 0) {
+      slot[0] = nextCursor++;
+    } else {
+      wasm_vtab_close(slot[0]); // the cursor is being rewound; abandon the previous scan
+    }
+    cursors.set(slot[0], rows[Symbol.iterator]());
+    return 0;
+  } catch(e) {
+    return fail(err, e);
+  }
+}
+
+// wasm_vtab_fill provides implementation of
+// C extern function with similar name defined in src/os_wasm.h
+// It packs up to max rows from the cursor's iterator into a buffer allocated using malloc, which
+// is released by C, and describes it in the wasm_vtab_batch at pBatch.
+export function wasm_vtab_fill(cursor, max, pBatch, err) {
+  try {
+    const it = cursors.get(cursor);
+    const rows = [];
+    let nCol = 0;
+    while(rows.length < max) {
+      const r = it.next();
+      if(r.done) break;
+      rows.push(r.value);
+      nCol = Math.max(nCol, r.value.length);
+    }
+
+    let ptr = 0;
+    if(rows.length > 0) {
+      ptr = heap.malloc(Math.max(measure(rows, nCol, null), 1));
+      pack(ptr, rows, nCol, null, { missing: NULL });
+    }
+
+    const batch = new Int32Array(memory.buffer, pBatch, 3);
+    batch[0] = ptr;
+    batch[1] = rows.length;
+    batch[2] = nCol;
+    return 0;
+  } catch(e) {
+    return fail(err, e);
+  }
+}
+
+// wasm_vtab_close provides implementation of
+// C extern function with similar name defined in src/os_wasm.h
+// It gives the iterator of the cursor a chance to clean up if the scan was abandoned half-way.
+export function wasm_vtab_close(cursor) {
+  const it = cursors.get(cursor);
+  cursors.delete(cursor);
+  if(it && _.isFunction(it.return)) it.return();
+}
+
+// wasm_module_destroy provides implementation of
+// C extern function with similar name defined in src/os_wasm.h
+export function wasm_module_destroy(id) {
+  modules.delete(id);
+}
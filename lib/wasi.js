@@ -5,10 +5,24 @@
 import * as _ from 'lodash';
 import { Buffer } from 'buffer';
 
+// WASIExit is thrown by proc_exit to unwind the stack of a program calling exit()
+export class WASIExit extends Error {
+  constructor(code) {
+    super(`exit(${code})`);
+    this.code = code;
+  }
+}
+
 // adapted from https://is.gd/x7M80e
+// options can contain args, the command-line arguments of a program (including it's name), and
+// stdout / stderr, functions receiving the text written to the respective file descriptors as is;
+// otherwise the text is written to the console a line at a time.
 export default class WASI {
-  constructor(memory, env) {
+  constructor(memory, env, options = {}) {
     this.memory = memory;
+    this.args = options.args || [];
+    this.stdout = options.stdout;
+    this.stderr = options.stderr;
 
     //- return codes
     this.WASI_ERRNO_SUCCESS = 0;
@@ -24,8 +38,8 @@ export default class WASI {
     // WASI namespace and the corresponding functions
     this.nameSpaces = {
       wasi_snapshot_preview1: {
-        args_get: undefined,
-        args_sizes_get: undefined,
+        args_get: this.args_get,
+        args_sizes_get: this.args_sizes_get,
 
         clock_res_get: this.clock_res_get,
         clock_time_get: this.clock_time_get,
@@ -68,7 +82,7 @@ export default class WASI {
 
         poll_oneoff: undefined,
 
-        proc_exit: undefined,
+        proc_exit: this.proc_exit,
         proc_raise: undefined,
 
         random_get: undefined,
@@ -96,6 +110,17 @@ export default class WASI {
     instance.exports._initialize();
   }
 
+  // start runs the main() of a program (a module exporting _start) and returns it's exit code
+  start(instance) {
+    try {
+      instance.exports._start();
+      return 0;
+    } catch(e) {
+      if(e instanceof WASIExit) return e.code;
+      throw e;
+    }
+  }
+
   get imports() {
     return this.nameSpaces;
   }
@@ -107,6 +132,30 @@ export default class WASI {
     };
   }
 
+  args_get(argv, argvBuf) {
+    const dataView = new DataView(this.memory.buffer);
+
+    let offset = argvBuf;
+    this.args.forEach((arg, i) => {
+      dataView.setUint32(argv + i * 4, offset, true);
+      offset += Buffer.from(this.memory.buffer).write(`${arg}\0`, offset);
+    });
+    return this.WASI_ERRNO_SUCCESS;
+  }
+
+  args_sizes_get(argc, argvBufSize) {
+    const size = this.args.reduce((acc, arg) => acc + Buffer.byteLength(`${arg}\0`), 0);
+
+    const dataView = new DataView(this.memory.buffer);
+    dataView.setUint32(argc, this.args.length, true);
+    dataView.setUint32(argvBufSize, size, true);
+    return this.WASI_ERRNO_SUCCESS;
+  }
+
+  proc_exit(code) {
+    throw new WASIExit(code);
+  }
+
   clock_res_get(id, resOut) {
     if (id !== 0) return this.WASI_ERRNO_INVAL;
     const view = new DataView(this.memory.buffer);
@@ -187,9 +236,11 @@ export default class WASI {
       buffer.set(b, offset);
       offset += b.length;
     });
-    const string = new TextDecoder("utf-8").decode(buffer).replace(/\n$/, "");
-    if (fd === 1) console.log(string);
-    else console.error(string);
+    const text = new TextDecoder("utf-8").decode(buffer);
+    const sink = fd === 1 ? this.stdout : this.stderr;
+    if (sink) sink(text);
+    else if (fd === 1) console.log(text.replace(/\n$/, ""));
+    else console.error(text.replace(/\n$/, ""));
     view.setUint32(nwritten, buffer.length, true);
     return this.WASI_ERRNO_SUCCESS;
   }
@@ -10,6 +10,7 @@ extern int sqlite3_wasm_vfs_init(void); // defined in wasm_vfs.c to register htt
 
 // statically linked extensions' entrypoints
 extern int sqlite3_series_init(sqlite3*, char**, const sqlite3_api_routines *);
+extern int sqlite3_typedarray_init(sqlite3*, char**, const sqlite3_api_routines *);
 
 /*
 ** sqlite3_os_init(...) is invoked by sqlite3 core to perform
@@ -23,6 +24,7 @@ int sqlite3_os_init(void) {
 
   // register statically linked extensions
   sqlite3_auto_extension(sqlite3_series_init);
+  sqlite3_auto_extension(sqlite3_typedarray_init);
 
   return rc;
 }
@@ -9,6 +9,7 @@
 #pragma once
 
 #include <sqlite3.h>
+#include <wasm_value.h>
 
 
 /* ******************** Other utilty methods  ******************** */
@@ -21,7 +22,138 @@
 int wasm_crypto_get_random(char* out, int n);
 
 /*
-** wasm_get_unix_epoch returns the current unix epoch as seconds from Jan 1, 1970.
+** wasm_get_unix_epoch returns the current unix epoch as milliseconds from Jan 1, 1970.
 ** See: lib/worker/environment.js#wasm_get_unix_epoch for default implementation.
 */
 sqlite3_int64 wasm_get_unix_epoch(void);
+
+
+/* ******************** Application-defined functions  ******************** */
+
+/*
+** wasm_function_call invokes the Javascript scalar function identified by id with the
+** argc arguments packed in aArg, and packs it's result into pOut. TEXT and BLOB results
+** must be allocated using malloc and are released by the caller. On error it returns
+** a non-zero code and, optionally, the error message packed as TEXT into pOut.
+** See: lib/functions.js#wasm_function_call for default implementation.
+*/
+int wasm_function_call(int id, int argc, wasm_value *aArg, wasm_value *pOut);
+
+/*
+** wasm_aggregate_step hands a batch of rows (a wasm_batch, see wasm_function.c) over to the
+** Javascript aggregate function identified by id. *piState identifies the aggregate's state in
+** Javascript and is set by the first call. Errors are reported like wasm_function_call does.
+** See: lib/functions.js#wasm_aggregate_step for default implementation.
+*/
+int wasm_aggregate_step(int id, int *piState, void *pBatch, wasm_value *pErr);
+
+/*
+** wasm_aggregate_final computes the result of the aggregate function identified by id for
+** the state iState (0 if no rows were ever stepped), packs it into pOut and releases the state.
+** pOut is null when the result is not needed.
+** See: lib/functions.js#wasm_aggregate_final for default implementation.
+*/
+int wasm_aggregate_final(int id, int iState, wasm_value *pOut);
+
+/*
+** wasm_function_destroy releases the Javascript function identified by id
+** See: lib/functions.js#wasm_function_destroy for default implementation.
+*/
+void wasm_function_destroy(int id);
+
+
+/* ******************** Virtual table modules  ******************** */
+
+/*
+** wasm_vtab_connect creates an instance of the Javascript module identified by id
+** given the module arguments in argv, sets *piTable to the identifier of the instance and
+** packs the CREATE TABLE statement declaring it's schema as TEXT into pOut. TEXT must be
+** allocated using malloc and is released by the caller. Errors are reported like
+** wasm_function_call does.
+** See: lib/vtab.js#wasm_vtab_connect for default implementation.
+*/
+int wasm_vtab_connect(int id, int argc, const char *const *argv, int *piTable, wasm_value *pOut);
+
+/*
+** wasm_vtab_disconnect releases the Javascript table instance identified by iTable
+** See: lib/vtab.js#wasm_vtab_disconnect for default implementation.
+*/
+void wasm_vtab_disconnect(int iTable);
+
+/*
+** wasm_vtab_best_index picks the query plan for a scan of the table iTable. aCons holds nCons
+** constraints and aOrderBy nOrderBy ORDER BY terms, flattened as described in wasm_vtab.c.
+** The plan is written into pPlan (a wasm_index_plan, see wasm_vtab.c) and aCons. It returns
+** SQLITE_CONSTRAINT if there's no usable plan given the constraints.
+** See: lib/vtab.js#wasm_vtab_best_index for default implementation.
+*/
+int wasm_vtab_best_index(int iTable, int nCons, int *aCons, int nOrderBy, int *aOrderBy, void *pPlan, wasm_value *pErr);
+
+/*
+** wasm_vtab_filter starts a new scan of the table iTable using the plan idxNum / idxStr and
+** the argc constraint values packed in aArg. *piCursor identifies the Javascript iterator of the
+** cursor and is set by the first call.
+** See: lib/vtab.js#wasm_vtab_filter for default implementation.
+*/
+int wasm_vtab_filter(int iTable, int *piCursor, int idxNum, const char *idxStr, int argc, wasm_value *aArg, wasm_value *pErr);
+
+/*
+** wasm_vtab_fill fetches up to nMax rows from the Javascript iterator iCursor into pBatch
+** (a wasm_vtab_batch, see wasm_vtab.c). Fewer than nMax rows means the scan is complete.
+** See: lib/vtab.js#wasm_vtab_fill for default implementation.
+*/
+int wasm_vtab_fill(int iCursor, int nMax, void *pBatch, wasm_value *pErr);
+
+/*
+** wasm_vtab_close releases the Javascript iterator identified by iCursor
+** See: lib/vtab.js#wasm_vtab_close for default implementation.
+*/
+void wasm_vtab_close(int iCursor);
+
+/*
+** wasm_module_destroy releases the Javascript module identified by id
+** See: lib/vtab.js#wasm_module_destroy for default implementation.
+*/
+void wasm_module_destroy(int id);
+
+
+/* ******************** Change feed  ******************** */
+
+/*
+** wasm_changes_commit hands the changes made by a transaction that's about to commit
+** (a wasm_changes, see wasm_hooks.c) over to the Javascript listener identified by id.
+** The changes are only valid for the duration of the call.
+** See: lib/changes.js#wasm_changes_commit for default implementation.
+*/
+void wasm_changes_commit(int id, void *pChanges);
+
+
+/* ******************** Opcode profiler  ******************** */
+
+/*
+** wasm_profile_clock returns a monotonic timestamp in nanoseconds, used to time every
+** opcode executed by the sqlite3.profile.wasm build (see wasm_profile.h).
+** See: lib/opcodes.js#wasm_profile_clock for default implementation.
+*/
+sqlite3_uint64 wasm_profile_clock(void);
+
+
+/* ******************** Tracing  ******************** */
+
+/*
+** wasm_trace_statement reports that pStmt started running zSql (eEvent 0) or that it
+** ended (eEvent 1, zSql is null), for connections traced by wasm_trace (see wasm_trace.c).
+** See: lib/trace.js#wasm_trace_statement for default implementation.
+*/
+void wasm_trace_statement(int eEvent, sqlite3_stmt *pStmt, const char *zSql);
+
+
+/* ******************** Progress handler  ******************** */
+
+/*
+** wasm_progress is called every few virtual machine instructions run by db, once its
+** progress handler is installed by wasm_progress_handler (see wasm_progress.c). It returns
+** non-zero to interrupt the statement running.
+** See: lib/progress.js#wasm_progress for default implementation.
+*/
+int wasm_progress(sqlite3 *db);
@@ -0,0 +1,55 @@
+/*
+** wasm_bind.c provides entrypoints that bind and execute statements
+** using parameters packed into a single buffer (see wasm_value.h), so that
+** Javascript can hand over many values in one call.
+*/
+
+#include <sqlite3.h>
+#include <wasm_value.h>
+
+/*
+** wasm_execute_many executes pStmt once for each of the nRow parameter sets
+** in the packed buffer zBuf, each made up of nParam consecutive slots. Rows produced
+** by the statement are discarded. Execution stops at the first error and the number
+** of parameter sets executed successfully is written to pnDone.
+**
+** Values are bound as SQLITE_STATIC and so bindings are cleared before returning,
+** as the caller is free to release zBuf afterwards.
+*/
+int wasm_execute_many(sqlite3_stmt *pStmt, const char *zBuf, int nRow, int nParam, int *pnDone) {
+  const wasm_value *aVal = (const wasm_value*)zBuf;
+  int rc = SQLITE_OK;
+  int i, j;
+
+  for(i=0; i<nRow && rc==SQLITE_OK; i++){
+    const wasm_value *aRow = &aVal[i*nParam];
+    for(j=0; j<nParam && rc==SQLITE_OK; j++){
+      rc = wasm_value_bind(pStmt, j+1, &aRow[j], zBuf, SQLITE_STATIC);
+    }
+    if( rc==SQLITE_OK ){
+      while( (rc = sqlite3_step(pStmt))==SQLITE_ROW ){}
+      if( rc==SQLITE_DONE ) rc = SQLITE_OK;
+    }
+    sqlite3_reset(pStmt);
+  }
+
+  sqlite3_clear_bindings(pStmt);
+  *pnDone = rc==SQLITE_OK ? i : i-1;
+  return rc;
+}
+
+/*
+** wasm_bind_packed binds the nParam slots in the packed buffer zBuf
+** to the parameters of pStmt, in order, stopping at the first error. 
+** Values are bound as SQLITE_TRANSIENT and so zBuf can be reused right away.
+*/
+int wasm_bind_packed(sqlite3_stmt *pStmt, const char *zBuf, int nParam) {
+  const wasm_value *aVal = (const wasm_value*)zBuf;
+  int rc = SQLITE_OK;
+  int i;
+
+  for(i=0; i<nParam && rc==SQLITE_OK; i++){
+    rc = wasm_value_bind(pStmt, i+1, &aVal[i], zBuf, SQLITE_TRANSIENT);
+  }
+  return rc;
+}
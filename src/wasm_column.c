@@ -0,0 +1,22 @@
+/*
+** wasm_column.c reads the datatypes of all the columns of a statement's
+** current row in a single call, instead of one sqlite3_column_type call per
+** column, for the row decoders of lib/decoder.js to pick a reader with.
+*/
+
+#include <sqlite3.h>
+
+/*
+** wasm_column_types writes the datatype (SQLITE_INTEGER, SQLITE_FLOAT,
+** SQLITE_TEXT, SQLITE_BLOB or SQLITE_NULL) of each of the first nCol columns
+** of the current row of pStmt to aOut, one byte per column, and returns the
+** number of columns written.
+*/
+int wasm_column_types(sqlite3_stmt *pStmt, unsigned char *aOut, int nCol) {
+  int i, n = sqlite3_data_count(pStmt);
+  if( n>nCol ) n = nCol;
+  for(i=0; i<n; i++){
+    aOut[i] = (unsigned char)sqlite3_column_type(pStmt, i);
+  }
+  return n;
+}
@@ -0,0 +1,285 @@
+/*
+** wasm_function.c implements sqlite3 application-defined functions
+** whose implementation lives in Javascript.
+**
+** Scalar functions cross into Javascript once per row, with all of the
+** arguments packed into wasm_value slots (see wasm_value.h), and read the
+** result back from a slot filled in by Javascript.
+**
+** Aggregate functions buffer the arguments of many rows into a columnar
+** batch (see wasm_batch below) and only cross into Javascript once the batch
+** is full, and once more when the final result is requested.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sqlite3.h>
+#include <os_wasm.h>
+#include <wasm_value.h>
+
+/*
+** wasm_function is the user data of every function registered
+** through wasm_create_function
+*/
+typedef struct wasm_function wasm_function;
+struct wasm_function {
+  int id;                 /* Identifier of the Javascript implementation */
+  int nBatch;             /* Aggregates: number of rows per batch; 0 for scalar functions */
+};
+
+/*
+** wasm_batch holds the arguments of up to nAlloc rows of an aggregate. Arguments
+** are stored column-major: the value of argument j in row i is at index j*nAlloc+i
+** of each array. Integers are stored as doubles in aNum, while the bytes of TEXT and
+** BLOB arguments are copied into zData, as sqlite3 only keeps them around for the
+** duration of the call to xStep. The layout must be kept in sync with lib/functions.js
+*/
+typedef struct wasm_batch wasm_batch;
+struct wasm_batch {
+  int nRow;               /* Number of rows in the batch */
+  int nArg;               /* Number of arguments per row */
+  int nAlloc;             /* Maximum number of rows in the batch */
+  unsigned char *aType;   /* Datatype of each argument */
+  double *aNum;           /* Value of INTEGER and FLOAT arguments */
+  int *aOff;              /* Offset into zData of TEXT and BLOB arguments */
+  int *aLen;              /* Size in bytes of TEXT and BLOB arguments */
+  char *zData;            /* Bytes of TEXT and BLOB arguments */
+  int nData;              /* Bytes used in zData */
+  int nDataAlloc;         /* Bytes allocated for zData */
+};
+
+/*
+** wasm_aggregate is the aggregate context of a single aggregate evaluation
+*/
+typedef struct wasm_aggregate wasm_aggregate;
+struct wasm_aggregate {
+  int iState;             /* Identifier of the Javascript state; 0 until first assigned */
+  wasm_batch *pBatch;     /* Rows buffered since the last call into Javascript */
+};
+
+/*
+** Report the error message packed into p by Javascript, releasing it's bytes
+*/
+static void wasmFunctionError(sqlite3_context *ctx, wasm_value *p) {
+  if( p->eType==SQLITE_TEXT ){
+    sqlite3_result_error(ctx, (const char*)(intptr_t)p->u.iOffset, p->n);
+    free((void*)(intptr_t)p->u.iOffset);
+  }else{
+    sqlite3_result_error(ctx, "javascript function failed", -1);
+  }
+}
+
+/*
+** xFunc of scalar functions
+*/
+static void wasmFunc(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+  wasm_function *pFunc = (wasm_function*)sqlite3_user_data(ctx);
+  wasm_value aStatic[8];
+  wasm_value *aArg = aStatic;
+  wasm_value result;
+  int i, rc;
+
+  if( argc>(int)(sizeof(aStatic)/sizeof(aStatic[0])) ){
+    aArg = (wasm_value*)sqlite3_malloc64(sizeof(wasm_value)*argc);
+    if( aArg==0 ){
+      sqlite3_result_error_nomem(ctx);
+      return;
+    }
+  }
+
+  for(i=0; i<argc; i++){
+    wasm_value_from(argv[i], &aArg[i]);
+  }
+
+  memset(&result, 0, sizeof(result));
+  rc = wasm_function_call(pFunc->id, argc, aArg, &result);
+  if( rc==SQLITE_OK ){
+    wasm_value_result(ctx, &result, 0, free); /* bytes were allocated by Javascript using malloc */
+  }else{
+    wasmFunctionError(ctx, &result);
+  }
+
+  if( aArg!=aStatic ) sqlite3_free(aArg);
+}
+
+/*
+** Allocate a new batch of nAlloc rows of nArg arguments
+*/
+static wasm_batch *wasmBatchNew(int nArg, int nAlloc) {
+  wasm_batch *p = (wasm_batch*)sqlite3_malloc64(sizeof(wasm_batch));
+  if( p==0 ) return 0;
+  memset(p, 0, sizeof(*p));
+
+  p->nArg = nArg;
+  p->nAlloc = nAlloc;
+  if( nArg>0 ){
+    p->aType = (unsigned char*)sqlite3_malloc64((sqlite3_uint64)nArg*nAlloc);
+    p->aNum = (double*)sqlite3_malloc64(sizeof(double)*(sqlite3_uint64)nArg*nAlloc);
+    p->aOff = (int*)sqlite3_malloc64(sizeof(int)*(sqlite3_uint64)nArg*nAlloc);
+    p->aLen = (int*)sqlite3_malloc64(sizeof(int)*(sqlite3_uint64)nArg*nAlloc);
+    if( p->aType==0 || p->aNum==0 || p->aOff==0 || p->aLen==0 ){
+      sqlite3_free(p->aType); sqlite3_free(p->aNum);
+      sqlite3_free(p->aOff); sqlite3_free(p->aLen);
+      sqlite3_free(p);
+      return 0;
+    }
+  }
+  return p;
+}
+
+/*
+** Release a batch and all of it's buffers
+*/
+static void wasmBatchFree(wasm_batch *p) {
+  if( p==0 ) return;
+  sqlite3_free(p->aType);
+  sqlite3_free(p->aNum);
+  sqlite3_free(p->aOff);
+  sqlite3_free(p->aLen);
+  sqlite3_free(p->zData);
+  sqlite3_free(p);
+}
+
+/*
+** Append a row of arguments to the batch, which must not be full
+*/
+static int wasmBatchAppend(wasm_batch *p, int argc, sqlite3_value **argv) {
+  int i;
+  for(i=0; i<argc; i++){
+    int k = i*p->nAlloc + p->nRow;
+    int eType = sqlite3_value_type(argv[i]);
+    p->aType[k] = (unsigned char)eType;
+    p->aNum[k] = 0;
+    p->aOff[k] = 0;
+    p->aLen[k] = 0;
+
+    if( eType==SQLITE_INTEGER || eType==SQLITE_FLOAT ){
+      p->aNum[k] = sqlite3_value_double(argv[i]);
+    }else if( eType==SQLITE_TEXT || eType==SQLITE_BLOB ){
+      const void *z = eType==SQLITE_TEXT ? (const void*)sqlite3_value_text(argv[i]) : sqlite3_value_blob(argv[i]);
+      int n = sqlite3_value_bytes(argv[i]);
+      if( p->nData+n>p->nDataAlloc ){
+        int nNew = p->nDataAlloc*2 + n + 64;
+        char *zNew = (char*)sqlite3_realloc64(p->zData, nNew);
+        if( zNew==0 ) return SQLITE_NOMEM;
+        p->zData = zNew;
+        p->nDataAlloc = nNew;
+      }
+      if( n>0 ) memcpy(&p->zData[p->nData], z, n);
+      p->aOff[k] = p->nData;
+      p->aLen[k] = n;
+      p->nData += n;
+    }
+  }
+  p->nRow++;
+  return SQLITE_OK;
+}
+
+/*
+** Hand the rows buffered in the aggregate's batch over to Javascript and empty the batch
+*/
+static int wasmAggregateFlush(sqlite3_context *ctx, wasm_function *pFunc, wasm_aggregate *pAgg) {
+  wasm_value err;
+  int rc;
+  if( pAgg->pBatch==0 || pAgg->pBatch->nRow==0 ) return SQLITE_OK;
+
+  memset(&err, 0, sizeof(err));
+  rc = wasm_aggregate_step(pFunc->id, &pAgg->iState, (void*)pAgg->pBatch, &err);
+  pAgg->pBatch->nRow = 0;
+  pAgg->pBatch->nData = 0;
+  if( rc!=SQLITE_OK ){
+    wasmFunctionError(ctx, &err);
+  }
+  return rc;
+}
+
+/*
+** xStep of aggregate functions
+*/
+static void wasmStep(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+  wasm_function *pFunc = (wasm_function*)sqlite3_user_data(ctx);
+  wasm_aggregate *pAgg = (wasm_aggregate*)sqlite3_aggregate_context(ctx, sizeof(wasm_aggregate));
+  if( pAgg==0 ){
+    sqlite3_result_error_nomem(ctx);
+    return;
+  }
+
+  if( pAgg->pBatch==0 ){
+    pAgg->pBatch = wasmBatchNew(argc, pFunc->nBatch);
+    if( pAgg->pBatch==0 ){
+      sqlite3_result_error_nomem(ctx);
+      return;
+    }
+  }
+
+  if( wasmBatchAppend(pAgg->pBatch, argc, argv)!=SQLITE_OK ){
+    sqlite3_result_error_nomem(ctx);
+    return;
+  }
+
+  if( pAgg->pBatch->nRow==pAgg->pBatch->nAlloc ){
+    wasmAggregateFlush(ctx, pFunc, pAgg);
+  }
+}
+
+/*
+** xFinal of aggregate functions
+*/
+static void wasmFinal(sqlite3_context *ctx) {
+  wasm_function *pFunc = (wasm_function*)sqlite3_user_data(ctx);
+  wasm_aggregate *pAgg = (wasm_aggregate*)sqlite3_aggregate_context(ctx, 0);
+  wasm_value result;
+  int iState = 0, rc;
+
+  if( pAgg!=0 ){
+    rc = wasmAggregateFlush(ctx, pFunc, pAgg);
+    iState = pAgg->iState;
+    wasmBatchFree(pAgg->pBatch);
+    pAgg->pBatch = 0;
+    if( rc!=SQLITE_OK ){
+      wasm_aggregate_final(pFunc->id, iState, 0); /* let Javascript release the state */
+      return;
+    }
+  }
+
+  memset(&result, 0, sizeof(result));
+  rc = wasm_aggregate_final(pFunc->id, iState, &result);
+  if( rc==SQLITE_OK ){
+    wasm_value_result(ctx, &result, 0, free);
+  }else{
+    wasmFunctionError(ctx, &result);
+  }
+}
+
+/*
+** xDestroy of all functions
+*/
+static void wasmFunctionDestroy(void *p) {
+  wasm_function *pFunc = (wasm_function*)p;
+  wasm_function_destroy(pFunc->id);
+  sqlite3_free(pFunc);
+}
+
+/*
+** wasm_create_function registers the Javascript function identified by id as zName, taking
+** nArg arguments (-1 for any number of them). If nBatch is zero the function is a scalar
+** function; else it's an aggregate that buffers nBatch rows before calling into Javascript.
+** eTextRep is passed on to sqlite3_create_function_v2 as is. The Javascript implementation is
+** released through wasm_function_destroy even if registering the function fails.
+*/
+int wasm_create_function(sqlite3 *db, const char *zName, int nArg, int eTextRep, int id, int nBatch) {
+  wasm_function *pFunc = (wasm_function*)sqlite3_malloc64(sizeof(wasm_function));
+  if( pFunc==0 ){
+    wasm_function_destroy(id);
+    return SQLITE_NOMEM;
+  }
+  pFunc->id = id;
+  pFunc->nBatch = nBatch;
+
+  if( nBatch>0 ){
+    return sqlite3_create_function_v2(db, zName, nArg, eTextRep, pFunc, 0, wasmStep, wasmFinal, wasmFunctionDestroy);
+  }else{
+    return sqlite3_create_function_v2(db, zName, nArg, eTextRep, pFunc, wasmFunc, 0, 0, wasmFunctionDestroy);
+  }
+}
@@ -0,0 +1,262 @@
+/*
+** wasm_hooks.c accumulates the rows changed by a transaction, using
+** sqlite3_update_hook, and hands them over to Javascript all at once when
+** the transaction commits (sqlite3_commit_hook), or discards them when it
+** rolls back (sqlite3_rollback_hook). That's a single call into Javascript
+** per transaction, no matter how many rows it changes.
+**
+** Neither hook fires on ROLLBACK TO, which undoes the changes made since a
+** savepoint without ending the transaction. Savepoints the binding opens are
+** mirrored with wasm_changes_savepoint, wasm_changes_rollback_to and
+** wasm_changes_release so that the changes rolled back are discarded too.
+**
+** Changes are buffered column-major in arrays that grow up to a fixed
+** capacity. Changes past the capacity are dropped, and only counted against
+** their table, so that Javascript knows the whole table may have changed.
+*/
+
+#include <string.h>
+#include <sqlite3.h>
+#include <os_wasm.h>
+
+/*
+** wasm_changes holds the changes of the current transaction of a connection.
+** It's layout must be kept in sync with lib/changes.js
+*/
+typedef struct wasm_changes wasm_changes;
+struct wasm_changes {
+  int nEntry;               /* Number of changes buffered */
+  int nAlloc;               /* Number of changes allocated */
+  int nCapacity;            /* Maximum number of changes buffered */
+  int nTable;               /* Number of tables changed */
+  int *aOp;                 /* SQLITE_INSERT, SQLITE_UPDATE or SQLITE_DELETE */
+  int *aTable;              /* Index into azTable of the table changed */
+  sqlite3_int64 *aRowid;    /* Rowid of the row changed */
+  char **azTable;           /* Names of the tables changed, as [schema.]table */
+  int *anDropped;           /* Number of changes dropped, per table */
+  int bDropped;             /* True if changes were dropped from unknown tables */
+  int nTableAlloc;          /* Number of tables allocated */
+  int id;                   /* Identifier of the Javascript listener */
+  int nSavepoint;           /* Number of savepoints open */
+  int nSavepointAlloc;      /* Number of savepoints allocated */
+  int *aSavepoint;          /* nEntry and nTable when each savepoint opened */
+};
+
+/*
+** Forget the changes of the current transaction, keeping the buffers around
+*/
+static void wasmChangesReset(wasm_changes *p) {
+  int i;
+  for(i=0; i<p->nTable; i++) sqlite3_free(p->azTable[i]);
+  p->nEntry = 0;
+  p->nTable = 0;
+  p->bDropped = 0;
+  p->nSavepoint = 0;
+}
+
+/*
+** Release the changes and all of their buffers
+*/
+static void wasmChangesFree(wasm_changes *p) {
+  if( p==0 ) return;
+  wasmChangesReset(p);
+  sqlite3_free(p->aOp);
+  sqlite3_free(p->aTable);
+  sqlite3_free(p->aRowid);
+  sqlite3_free(p->azTable);
+  sqlite3_free(p->anDropped);
+  sqlite3_free(p->aSavepoint);
+  sqlite3_free(p);
+}
+
+static void wasmUpdateHook(void*, int, const char*, const char*, sqlite3_int64);
+
+/*
+** Return the changes collected on db, or NULL if there's no listener. The update
+** hook is the only way to get them back from db, and it's restored right away.
+*/
+static wasm_changes *wasmChangesOf(sqlite3 *db) {
+  void *p = sqlite3_update_hook(db, 0, 0);
+  if( p ) sqlite3_update_hook(db, wasmUpdateHook, p);
+  return (wasm_changes*)p;
+}
+
+/*
+** Return the index of table zTab of schema zDb, adding it if required, or -1 on OOM.
+** Tables of the main schema are named as is; others are qualified with the schema.
+*/
+static int wasmChangesTable(wasm_changes *p, const char *zDb, const char *zTab) {
+  int i, bMain = sqlite3_stricmp(zDb, "main")==0;
+  char *zName;
+
+  for(i=p->nTable-1; i>=0; i--){ /* the most recently changed table is the likeliest */
+    const char *z = p->azTable[i];
+    if( bMain ){
+      if( strcmp(z, zTab)==0 ) return i;
+    }else{
+      int n = (int)strlen(zDb);
+      if( strncmp(z, zDb, n)==0 && z[n]=='.' && strcmp(&z[n+1], zTab)==0 ) return i;
+    }
+  }
+
+  if( p->nTable==p->nTableAlloc ){
+    int nNew = p->nTableAlloc ? p->nTableAlloc*2 : 8;
+    char **azNew = (char**)sqlite3_realloc64(p->azTable, sizeof(char*)*nNew);
+    int *anNew;
+    if( azNew==0 ) return -1;
+    p->azTable = azNew;
+    anNew = (int*)sqlite3_realloc64(p->anDropped, sizeof(int)*nNew);
+    if( anNew==0 ) return -1;
+    p->anDropped = anNew;
+    p->nTableAlloc = nNew;
+  }
+
+  zName = bMain ? sqlite3_mprintf("%s", zTab) : sqlite3_mprintf("%s.%s", zDb, zTab);
+  if( zName==0 ) return -1;
+  p->azTable[p->nTable] = zName;
+  p->anDropped[p->nTable] = 0;
+  return p->nTable++;
+}
+
+/*
+** Grow the change buffers, up to the capacity. Returns SQLITE_OK or SQLITE_FULL.
+*/
+static int wasmChangesGrow(wasm_changes *p) {
+  int nNew = p->nAlloc ? p->nAlloc*2 : 256;
+  int *aOp, *aTable;
+  sqlite3_int64 *aRowid;
+
+  if( p->nAlloc>=p->nCapacity ) return SQLITE_FULL;
+  if( nNew>p->nCapacity ) nNew = p->nCapacity;
+
+  aOp = (int*)sqlite3_realloc64(p->aOp, sizeof(int)*nNew);
+  if( aOp==0 ) return SQLITE_FULL;
+  p->aOp = aOp;
+  aTable = (int*)sqlite3_realloc64(p->aTable, sizeof(int)*nNew);
+  if( aTable==0 ) return SQLITE_FULL;
+  p->aTable = aTable;
+  aRowid = (sqlite3_int64*)sqlite3_realloc64(p->aRowid, sizeof(sqlite3_int64)*nNew);
+  if( aRowid==0 ) return SQLITE_FULL;
+  p->aRowid = aRowid;
+
+  p->nAlloc = nNew;
+  return SQLITE_OK;
+}
+
+/*
+** The update hook; buffers a single change
+*/
+static void wasmUpdateHook(void *pArg, int op, const char *zDb, const char *zTab, sqlite3_int64 iRowid) {
+  wasm_changes *p = (wasm_changes*)pArg;
+  int iTable = wasmChangesTable(p, zDb, zTab);
+  if( iTable<0 ){
+    p->bDropped = 1;
+    return;
+  }
+
+  if( p->nEntry==p->nAlloc && wasmChangesGrow(p)!=SQLITE_OK ){
+    p->anDropped[iTable]++;
+    return;
+  }
+  p->aOp[p->nEntry] = op;
+  p->aTable[p->nEntry] = iTable;
+  p->aRowid[p->nEntry] = iRowid;
+  p->nEntry++;
+}
+
+/*
+** The commit hook; hands the changes over to Javascript. It never turns
+** the commit into a rollback.
+*/
+static int wasmCommitHook(void *pArg) {
+  wasm_changes *p = (wasm_changes*)pArg;
+  if( p->nEntry>0 || p->nTable>0 || p->bDropped ){
+    wasm_changes_commit(p->id, (void*)p);
+  }
+  wasmChangesReset(p);
+  return 0;
+}
+
+/*
+** The rollback hook; discards the changes
+*/
+static void wasmRollbackHook(void *pArg) {
+  wasmChangesReset((wasm_changes*)pArg);
+}
+
+/*
+** wasm_changes_open starts collecting the changes made by transactions of db on
+** behalf of the Javascript listener identified by id, buffering up to nCapacity
+** changes per transaction. It replaces any update, commit and rollback hooks
+** previously registered on db.
+*/
+int wasm_changes_open(sqlite3 *db, int id, int nCapacity) {
+  wasm_changes *p = (wasm_changes*)sqlite3_malloc(sizeof(wasm_changes));
+  if( p==0 ) return SQLITE_NOMEM;
+  memset(p, 0, sizeof(*p));
+  p->id = id;
+  p->nCapacity = nCapacity>0 ? nCapacity : 1;
+
+  wasmChangesFree((wasm_changes*)sqlite3_update_hook(db, wasmUpdateHook, p));
+  sqlite3_commit_hook(db, wasmCommitHook, p);
+  sqlite3_rollback_hook(db, wasmRollbackHook, p);
+  return SQLITE_OK;
+}
+
+/*
+** wasm_changes_close stops collecting changes made by transactions of db and
+** removes the hooks installed by wasm_changes_open.
+*/
+void wasm_changes_close(sqlite3 *db) {
+  sqlite3_commit_hook(db, 0, 0);
+  sqlite3_rollback_hook(db, 0, 0);
+  wasmChangesFree((wasm_changes*)sqlite3_update_hook(db, 0, 0));
+}
+
+/*
+** wasm_changes_savepoint marks the changes buffered so far by db, as a savepoint
+** is opened. Returns SQLITE_OK, or SQLITE_NOMEM in which case nothing is marked
+** and the caller must not call wasm_changes_rollback_to or wasm_changes_release
+** for it, as they would act on the enclosing savepoint; lib/connection.js gives up
+** the savepoint instead. It's a no-op if no changes are collected.
+*/
+int wasm_changes_savepoint(sqlite3 *db) {
+  wasm_changes *p = wasmChangesOf(db);
+  if( p==0 ) return SQLITE_OK;
+  if( p->nSavepoint==p->nSavepointAlloc ){
+    int nNew = p->nSavepointAlloc ? p->nSavepointAlloc*2 : 4;
+    int *aNew = (int*)sqlite3_realloc64(p->aSavepoint, sizeof(int)*2*nNew);
+    if( aNew==0 ) return SQLITE_NOMEM;
+    p->aSavepoint = aNew;
+    p->nSavepointAlloc = nNew;
+  }
+  p->aSavepoint[p->nSavepoint*2] = p->nEntry;
+  p->aSavepoint[p->nSavepoint*2+1] = p->nTable;
+  p->nSavepoint++;
+  return SQLITE_OK;
+}
+
+/*
+** wasm_changes_rollback_to discards the changes buffered by db since the
+** innermost savepoint was marked, as it's rolled back with ROLLBACK TO. The
+** savepoint stays open. Tables first changed since are forgotten along with
+** the changes they dropped; changes dropped since by the other tables are
+** still counted, as there's no telling them apart from earlier ones.
+*/
+void wasm_changes_rollback_to(sqlite3 *db) {
+  wasm_changes *p = wasmChangesOf(db);
+  int i, nTable;
+  if( p==0 || p->nSavepoint==0 ) return;
+  p->nEntry = p->aSavepoint[(p->nSavepoint-1)*2];
+  nTable = p->aSavepoint[(p->nSavepoint-1)*2+1];
+  for(i=nTable; i<p->nTable; i++) sqlite3_free(p->azTable[i]);
+  if( nTable<p->nTable ) p->nTable = nTable;
+}
+
+/*
+** wasm_changes_release forgets the innermost savepoint marked on db, as it's released
+*/
+void wasm_changes_release(sqlite3 *db) {
+  wasm_changes *p = wasmChangesOf(db);
+  if( p && p->nSavepoint>0 ) p->nSavepoint--;
+}
@@ -0,0 +1,268 @@
+/*
+** wasm_malloc.c is an allocation profiler. Once installed it wraps sqlite3's
+** allocator (SQLITE_CONFIG_MALLOC), prefixing every allocation with a small
+** header recording it's size and origin, and keeps the live bytes and a size
+** histogram of the allocations of every origin.
+**
+** sqlite3 doesn't tell the allocator who's asking, so the origin is the tag
+** current at the time of the allocation. The tag is set by lib/allocations.js
+** around the calls it makes into sqlite3 (statements, schema loading, memdb,
+** allocations made on behalf of Javascript), and here around the page cache
+** methods (SQLITE_CONFIG_PCACHE2), which are wrapped for that purpose.
+** Allocations keep the tag they were made with when resized.
+*/
+
+#include <string.h>
+#include <sqlite3.h>
+
+/*
+** Origins allocations are attributed to; must be kept in sync with lib/allocations.js
+*/
+#define WASM_MALLOC_OTHER   0
+#define WASM_MALLOC_PAGER   1
+#define WASM_MALLOC_SCHEMA  2
+#define WASM_MALLOC_VDBE    3
+#define WASM_MALLOC_FTS5    4
+#define WASM_MALLOC_MEMDB   5
+#define WASM_MALLOC_JS      6
+#define WASM_MALLOC_TAGS    7
+
+/*
+** Allocation sizes are grouped into power of two classes: class i holds sizes in (2^(i-1), 2^i]
+*/
+#define WASM_MALLOC_CLASSES 32
+
+/*
+** Counters of a single origin, as copied out by wasm_malloc_snapshot; must be kept in sync with lib/allocations.js
+*/
+typedef struct wasm_malloc_stat wasm_malloc_stat;
+struct wasm_malloc_stat {
+  sqlite3_int64 nLive;              /* bytes currently allocated */
+  sqlite3_int64 nTotal;             /* bytes ever allocated */
+  int nLiveCount;                   /* allocations currently live */
+  int nCount;                       /* allocations ever made, including resizes */
+  int aLive[WASM_MALLOC_CLASSES];   /* live allocations per size class */
+  int aCount[WASM_MALLOC_CLASSES];  /* allocations ever made per size class */
+};
+
+/*
+** Header in front of every allocation, which keeps it 8-byte aligned
+*/
+typedef struct wasm_malloc_hdr wasm_malloc_hdr;
+struct wasm_malloc_hdr {
+  int nSize;
+  int iTag;
+};
+
+#define HDR ((int)sizeof(wasm_malloc_hdr))
+#define ROUND8(n) (((n)+7)&~7)
+
+static struct {
+  int bInstalled;
+  int iTag;                                  /* origin of the allocations made now */
+  sqlite3_mem_methods mem;                   /* the allocator wrapped */
+  sqlite3_pcache_methods2 pcache;            /* the page cache wrapped */
+  wasm_malloc_stat aStat[WASM_MALLOC_TAGS];
+} g;
+
+/*
+** sizeClass returns the size class of n
+*/
+static int sizeClass(int n) {
+  int i = 0;
+  while( i<WASM_MALLOC_CLASSES-1 && (1<<i)<n ) i++;
+  return i;
+}
+
+/* account for a new allocation of n bytes made by iTag */
+static void allocated(int iTag, int n) {
+  wasm_malloc_stat *p = &g.aStat[iTag];
+  int i = sizeClass(n);
+  p->nLive += n;
+  p->nTotal += n;
+  p->nLiveCount++;
+  p->nCount++;
+  p->aLive[i]++;
+  p->aCount[i]++;
+}
+
+/* account for an allocation of n bytes made by iTag being freed */
+static void freed(int iTag, int n) {
+  wasm_malloc_stat *p = &g.aStat[iTag];
+  p->nLive -= n;
+  p->nLiveCount--;
+  p->aLive[sizeClass(n)]--;
+}
+
+/*
+** The allocator methods; sizes are rounded up to a multiple of 8 so that
+** the size recorded is the one xSize reports.
+*/
+static void *profMalloc(int n) {
+  wasm_malloc_hdr *p;
+  n = ROUND8(n);
+  p = (wasm_malloc_hdr*)g.mem.xMalloc(n + HDR);
+  if( p==0 ) return 0;
+  p->nSize = n;
+  p->iTag = g.iTag;
+  allocated(p->iTag, n);
+  return (void*)&p[1];
+}
+
+static void profFree(void *pPrior) {
+  wasm_malloc_hdr *p = &((wasm_malloc_hdr*)pPrior)[-1];
+  freed(p->iTag, p->nSize);
+  g.mem.xFree(p);
+}
+
+static void *profRealloc(void *pPrior, int n) {
+  wasm_malloc_hdr *p = &((wasm_malloc_hdr*)pPrior)[-1];
+  int nOld = p->nSize, iTag = p->iTag;
+  n = ROUND8(n);
+  p = (wasm_malloc_hdr*)g.mem.xRealloc(p, n + HDR);
+  if( p==0 ) return 0;
+  freed(iTag, nOld);
+  allocated(iTag, n);
+  p->nSize = n;
+  return (void*)&p[1];
+}
+
+static int profSize(void *pPrior) {
+  return ((wasm_malloc_hdr*)pPrior)[-1].nSize;
+}
+
+static int profRoundup(int n) {
+  return ROUND8(n);
+}
+
+static int profInit(void *pAppData) {
+  return g.mem.xInit(g.mem.pAppData);
+}
+
+static void profShutdown(void *pAppData) {
+  g.mem.xShutdown(g.mem.pAppData);
+}
+
+static const sqlite3_mem_methods profMem = {
+  profMalloc, profFree, profRealloc, profSize, profRoundup, profInit, profShutdown, 0
+};
+
+/*
+** The page cache methods, which attribute whatever they allocate to the pager
+*/
+#define PAGER_BEGIN int iPrior = g.iTag; g.iTag = WASM_MALLOC_PAGER
+#define PAGER_END g.iTag = iPrior
+
+static int pcacheInit(void *pArg) {
+  return g.pcache.xInit ? g.pcache.xInit(pArg) : SQLITE_OK;
+}
+
+static void pcacheShutdown(void *pArg) {
+  if( g.pcache.xShutdown ) g.pcache.xShutdown(pArg);
+}
+
+static sqlite3_pcache *pcacheCreate(int szPage, int szExtra, int bPurgeable) {
+  sqlite3_pcache *p;
+  PAGER_BEGIN;
+  p = g.pcache.xCreate(szPage, szExtra, bPurgeable);
+  PAGER_END;
+  return p;
+}
+
+static void pcacheCachesize(sqlite3_pcache *p, int nCachesize) {
+  PAGER_BEGIN;
+  g.pcache.xCachesize(p, nCachesize);
+  PAGER_END;
+}
+
+static int pcachePagecount(sqlite3_pcache *p) {
+  return g.pcache.xPagecount(p);
+}
+
+static sqlite3_pcache_page *pcacheFetch(sqlite3_pcache *p, unsigned key, int createFlag) {
+  sqlite3_pcache_page *pPage;
+  PAGER_BEGIN;
+  pPage = g.pcache.xFetch(p, key, createFlag);
+  PAGER_END;
+  return pPage;
+}
+
+static void pcacheUnpin(sqlite3_pcache *p, sqlite3_pcache_page *pPage, int discard) {
+  PAGER_BEGIN;
+  g.pcache.xUnpin(p, pPage, discard);
+  PAGER_END;
+}
+
+static void pcacheRekey(sqlite3_pcache *p, sqlite3_pcache_page *pPage, unsigned oldKey, unsigned newKey) {
+  g.pcache.xRekey(p, pPage, oldKey, newKey);
+}
+
+static void pcacheTruncate(sqlite3_pcache *p, unsigned iLimit) {
+  PAGER_BEGIN;
+  g.pcache.xTruncate(p, iLimit);
+  PAGER_END;
+}
+
+static void pcacheDestroy(sqlite3_pcache *p) {
+  PAGER_BEGIN;
+  g.pcache.xDestroy(p);
+  PAGER_END;
+}
+
+static void pcacheShrink(sqlite3_pcache *p) {
+  PAGER_BEGIN;
+  g.pcache.xShrink(p);
+  PAGER_END;
+}
+
+static sqlite3_pcache_methods2 profPcache = {
+  1, 0, pcacheInit, pcacheShutdown, pcacheCreate, pcacheCachesize, pcachePagecount,
+  pcacheFetch, pcacheUnpin, pcacheRekey, pcacheTruncate, pcacheDestroy, pcacheShrink
+};
+
+/*
+** wasm_malloc_install installs the profiler: the allocator and page cache
+** wrappers. Like any allocator, it can only be installed before the library
+** is initialized, and it returns SQLITE_MISUSE once it is. It stays installed
+** from then on. As allocations made before can't be told apart, it must be
+** installed before the library is first initialized.
+*/
+int wasm_malloc_install(void) {
+  int rc;
+  if( g.bInstalled ) return SQLITE_OK;
+
+  rc = sqlite3_config(SQLITE_CONFIG_GETMALLOC, &g.mem);
+  if( rc==SQLITE_OK ) rc = sqlite3_config(SQLITE_CONFIG_GETPCACHE2, &g.pcache);
+  if( rc==SQLITE_OK ) rc = sqlite3_config(SQLITE_CONFIG_MALLOC, &profMem);
+  if( rc!=SQLITE_OK ) return rc;
+
+  profPcache.pArg = g.pcache.pArg;
+  rc = sqlite3_config(SQLITE_CONFIG_PCACHE2, &profPcache);
+  if( rc!=SQLITE_OK ){
+    sqlite3_config(SQLITE_CONFIG_MALLOC, &g.mem);
+    return rc;
+  }
+  g.bInstalled = 1;
+  return SQLITE_OK;
+}
+
+/*
+** wasm_malloc_tag makes iTag the origin of the allocations made from now on,
+** and returns the previous one, for the caller to restore.
+*/
+int wasm_malloc_tag(int iTag) {
+  int iPrior = g.iTag;
+  g.iTag = (iTag>=0 && iTag<WASM_MALLOC_TAGS) ? iTag : WASM_MALLOC_OTHER;
+  return iPrior;
+}
+
+/*
+** wasm_malloc_snapshot copies the counters of every origin, in the order of
+** their tags, into aOut and returns the number of origins, or 0 if the
+** profiler isn't installed.
+*/
+int wasm_malloc_snapshot(wasm_malloc_stat *aOut) {
+  if( !g.bInstalled ) return 0;
+  memcpy(aOut, g.aStat, sizeof(g.aStat));
+  return WASM_MALLOC_TAGS;
+}
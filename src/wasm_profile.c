@@ -0,0 +1,260 @@
+/*
+** wasm_profile.c collects the per-opcode counters of the VDBE_PROFILE
+** build (sqlite3.profile.wasm, see wasm_profile.h) into an opcode table
+** per statement, keyed by the statement's SQL text, and a global one.
+**
+** The VDBE hands the counters of a statement over by writing them to
+** "vdbe_profile.out" whenever the statement is reset or finalized, as a
+** header line with the opcodes in hex, the SQL text as "-- " comments and
+** one line per instruction:
+**
+**    count  time  time/count  addr opcode p1 p2 p3 p4 p5 comment
+**
+** wasm_profile_open captures that into a memory stream and wasm_profile_close
+** parses it. In other builds the tables are always empty.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <sqlite3.h>
+
+/*
+** wasm_opcode_stat holds the counters of a single opcode. It's 24 bytes wide
+** on wasm32 and it's layout must be kept in sync with lib/opcodes.js
+*/
+typedef struct wasm_opcode_stat wasm_opcode_stat;
+struct wasm_opcode_stat {
+  const char *zName;        /* Name of the opcode */
+  int iOpcode;              /* Numeric value of the opcode */
+  sqlite3_uint64 nCount;    /* Number of times the opcode was executed */
+  sqlite3_uint64 nTime;     /* Nanoseconds spent executing the opcode */
+};
+
+#ifdef VDBE_PROFILE
+
+#undef fopen
+#undef fclose
+
+#define WASM_OPCODES 256
+
+/*
+** wasm_opcode_table holds the counters of every opcode, either of all
+** statements or of the statements with the SQL text zSql.
+*/
+typedef struct wasm_opcode_table wasm_opcode_table;
+struct wasm_opcode_table {
+  char *zSql;                             /* SQL text, or NULL for the global table */
+  sqlite3_uint64 aCount[WASM_OPCODES];    /* Executions, per opcode */
+  sqlite3_uint64 aTime[WASM_OPCODES];     /* Nanoseconds, per opcode */
+  wasm_opcode_table *pNext;               /* Next statement table */
+};
+
+static struct {
+  wasm_opcode_table global;               /* Counters of all statements */
+  wasm_opcode_table *pStmt;               /* List of per-statement tables */
+  char *azName[WASM_OPCODES];             /* Opcode names, as they are seen */
+  sqlite3_uint64 nOverhead;               /* Nanoseconds measured by an empty clock pair */
+  int bCalibrated;                        /* True once nOverhead is measured */
+  FILE *pOut;                             /* Memory stream of the dump being written */
+  char *zBuf;                             /* Buffer of pOut */
+  size_t nBuf;                            /* Size of zBuf */
+} wasmProfile;
+
+/*
+** Length of zSql, ignoring a trailing newline; the dump can't tell whether there was one
+*/
+static int wasmProfileSqlLen(const char *zSql) {
+  int n = (int)strlen(zSql);
+  if( n>0 && zSql[n-1]=='\n' ) n--;
+  return n;
+}
+
+/*
+** Return the table of the statements with SQL text zSql (of nSql bytes), creating it
+** if bCreate is true. The global table is returned for a NULL zSql.
+*/
+static wasm_opcode_table *wasmProfileTable(const char *zSql, int nSql, int bCreate) {
+  wasm_opcode_table *p;
+  if( zSql==0 ) return &wasmProfile.global;
+
+  for(p=wasmProfile.pStmt; p; p=p->pNext){
+    if( (int)strlen(p->zSql)==nSql && memcmp(p->zSql, zSql, nSql)==0 ) return p;
+  }
+  if( !bCreate ) return 0;
+
+  p = (wasm_opcode_table*)sqlite3_malloc(sizeof(wasm_opcode_table));
+  if( p==0 ) return 0;
+  memset(p, 0, sizeof(*p));
+  p->zSql = sqlite3_mprintf("%.*s", nSql, zSql);
+  if( p->zSql==0 ){
+    sqlite3_free(p);
+    return 0;
+  }
+  p->pNext = wasmProfile.pStmt;
+  wasmProfile.pStmt = p;
+  return p;
+}
+
+/*
+** Measure the nanoseconds a pair of back-to-back clock reads accounts for, which
+** is included in the time of every opcode executed
+*/
+static void wasmProfileCalibrate(void) {
+  sqlite3_uint64 iStart, iEnd;
+  int i;
+  iStart = wasm_profile_clock();
+  for(i=0; i<1000; i++) iEnd = wasm_profile_clock();
+  wasmProfile.nOverhead = (iEnd - iStart) / 1000;
+  wasmProfile.bCalibrated = 1;
+}
+
+/*
+** Fold the dump of a single statement, of nBuf bytes, into the opcode tables
+*/
+static void wasmProfileParse(char *zBuf, size_t nBuf) {
+  unsigned char *aOp = 0;
+  int nOp = 0, nSql = 0, iNext = 0;
+  char *zSql = 0;
+  char *z = zBuf, *zEnd = zBuf + nBuf, *zEol;
+  wasm_opcode_table *pStmt = 0;
+
+  for(; z<zEnd; z=zEol+1){
+    zEol = memchr(z, '\n', zEnd - z);
+    if( zEol==0 ) zEol = zEnd;
+    *zEol = 0;
+
+    if( strncmp(z, "---- ", 5)==0 ){
+      /* the opcodes of the program, two hex digits each */
+      int i;
+      nOp = (int)(zEol - z - 5) / 2;
+      sqlite3_free(aOp);
+      aOp = (unsigned char*)sqlite3_malloc(nOp>0 ? nOp : 1);
+      if( aOp==0 ) break;
+      for(i=0; i<nOp; i++){
+        unsigned int x;
+        sscanf(&z[5 + 2*i], "%2x", &x);
+        aOp[i] = (unsigned char)x;
+      }
+    }else if( strncmp(z, "-- ", 3)==0 && iNext==0 ){
+      /* a line of the SQL text; lines are kept in place, joined by the newlines in zBuf */
+      if( zSql==0 ){
+        zSql = z + 3;
+        nSql = (int)(zEol - zSql);
+      }else{
+        memmove(zSql + nSql + 1, z + 3, zEol - z - 3);
+        zSql[nSql] = '\n';
+        nSql += 1 + (int)(zEol - z - 3);
+      }
+    }else if( aOp ){
+      unsigned int nCount;
+      unsigned long long nTime, nAvg;
+      int iAddr;
+      char zName[32];
+      /* lines that don't parse, or aren't the next instruction, continue a multi-line P4 */
+      if( sscanf(z, "%u %llu %llu %d %31s", &nCount, &nTime, &nAvg, &iAddr, zName)!=5 ) continue;
+      if( iAddr!=iNext || iAddr>=nOp ) continue;
+      iNext++;
+
+      if( wasmProfile.azName[aOp[iAddr]]==0 ){
+        wasmProfile.azName[aOp[iAddr]] = sqlite3_mprintf("%s", zName);
+      }
+      if( pStmt==0 && zSql ) pStmt = wasmProfileTable(zSql, nSql, 1);
+      if( nCount==0 ) continue;
+
+      nTime = nTime > nCount*wasmProfile.nOverhead ? nTime - nCount*wasmProfile.nOverhead : 0;
+      wasmProfile.global.aCount[aOp[iAddr]] += nCount;
+      wasmProfile.global.aTime[aOp[iAddr]] += nTime;
+      if( pStmt ){
+        pStmt->aCount[aOp[iAddr]] += nCount;
+        pStmt->aTime[aOp[iAddr]] += nTime;
+      }
+    }
+  }
+  sqlite3_free(aOp);
+}
+
+/*
+** wasm_profile_open stands in for fopen. It opens a memory stream for "vdbe_profile.out";
+** there are no other files.
+*/
+FILE *wasm_profile_open(const char *zPath, const char *zMode) {
+  (void)zMode;
+  if( strcmp(zPath, "vdbe_profile.out")!=0 || wasmProfile.pOut ) return 0;
+  if( !wasmProfile.bCalibrated ) wasmProfileCalibrate();
+  wasmProfile.pOut = open_memstream(&wasmProfile.zBuf, &wasmProfile.nBuf);
+  return wasmProfile.pOut;
+}
+
+/*
+** wasm_profile_close stands in for fclose. Closing the stream opened by wasm_profile_open
+** folds the dump into the opcode tables.
+*/
+int wasm_profile_close(FILE *pFile) {
+  int rc = fclose(pFile);
+  if( pFile==wasmProfile.pOut ){
+    if( rc==0 && wasmProfile.zBuf ) wasmProfileParse(wasmProfile.zBuf, wasmProfile.nBuf);
+    free(wasmProfile.zBuf);
+    wasmProfile.zBuf = 0;
+    wasmProfile.nBuf = 0;
+    wasmProfile.pOut = 0;
+  }
+  return rc;
+}
+
+#endif /* VDBE_PROFILE */
+
+/*
+** wasm_profile_enabled returns true if this is the VDBE_PROFILE build
+*/
+int wasm_profile_enabled(void) {
+#ifdef VDBE_PROFILE
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+/*
+** wasm_profile_opcodes fills aStat with the counters of up to nMax opcodes that were
+** executed by statements with the SQL text zSql, or by all statements if zSql is NULL,
+** and returns the number of such opcodes, which might be more than nMax. Counters of a
+** statement are only collected when it's reset or finalized.
+*/
+int wasm_profile_opcodes(const char *zSql, wasm_opcode_stat *aStat, int nMax) {
+  int n = 0;
+#ifdef VDBE_PROFILE
+  int i;
+  wasm_opcode_table *p = wasmProfileTable(zSql, zSql ? wasmProfileSqlLen(zSql) : 0, 0);
+  if( p==0 ) return 0;
+  for(i=0; i<WASM_OPCODES; i++){
+    if( p->aCount[i]==0 ) continue;
+    if( n<nMax ){
+      aStat[n].zName = wasmProfile.azName[i];
+      aStat[n].iOpcode = i;
+      aStat[n].nCount = p->aCount[i];
+      aStat[n].nTime = p->aTime[i];
+    }
+    n++;
+  }
+#else
+  (void)zSql; (void)aStat; (void)nMax;
+#endif
+  return n;
+}
+
+/*
+** wasm_profile_reset clears the global and all per-statement opcode tables
+*/
+void wasm_profile_reset(void) {
+#ifdef VDBE_PROFILE
+  wasm_opcode_table *p, *pNext;
+  for(p=wasmProfile.pStmt; p; p=pNext){
+    pNext = p->pNext;
+    sqlite3_free(p->zSql);
+    sqlite3_free(p);
+  }
+  wasmProfile.pStmt = 0;
+  memset(wasmProfile.global.aCount, 0, sizeof(wasmProfile.global.aCount));
+  memset(wasmProfile.global.aTime, 0, sizeof(wasmProfile.global.aTime));
+#endif
+}
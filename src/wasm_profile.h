@@ -0,0 +1,40 @@
+/*
+** wasm_profile.h is force-included (using -include) into every translation
+** unit of the sqlite3.profile.wasm build, which compiles sqlite3 with
+** VDBE_PROFILE. It must not depend on sqlite3.h.
+**
+** With VDBE_PROFILE the VDBE counts the executions of every opcode of a
+** statement and accumulates the time spent in them, as measured by
+** sqlite3Hwtime(), and dumps the counters into the file "vdbe_profile.out"
+** whenever the statement is reset. There's neither a cycle counter nor a
+** filesystem in WebAssembly, so:
+**
+**   - sqlite3Hwtime() is mapped onto the wasm_profile_clock import; the
+**     build must define SQLITE_HWTIME_H so that hwtime.h is skipped.
+**
+**   - fopen() and fclose() are mapped onto wasm_profile_open and
+**     wasm_profile_close (see wasm_profile.c), which capture the dump in
+**     memory and fold it into per-statement and global opcode tables.
+*/
+
+#pragma once
+
+#ifdef VDBE_PROFILE
+
+#include <stdio.h>
+
+/*
+** wasm_profile_clock returns a monotonic timestamp in nanoseconds.
+** See: lib/opcodes.js#wasm_profile_clock for default implementation.
+*/
+unsigned long long wasm_profile_clock(void);
+
+#define sqlite3Hwtime() wasm_profile_clock()
+
+FILE *wasm_profile_open(const char *zPath, const char *zMode);
+int wasm_profile_close(FILE *pFile);
+
+#define fopen(P,M) wasm_profile_open(P,M)   /* undefined again by wasm_profile.c */
+#define fclose(F) wasm_profile_close(F)
+
+#endif /* VDBE_PROFILE */
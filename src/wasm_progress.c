@@ -0,0 +1,30 @@
+/*
+** wasm_progress.c installs a progress handler that calls into Javascript
+** every few virtual machine instructions, so that a statement can be
+** cancelled while it runs (as when another thread sets a flag in a
+** SharedArrayBuffer, or a deadline passes) and so that Javascript can count
+** the instructions run towards a time slice. See lib/progress.js.
+*/
+
+#include <sqlite3.h>
+#include <os_wasm.h>
+
+/*
+** progressCallback is the sqlite3_progress_handler callback; the statement
+** running is interrupted if it returns non-zero
+*/
+static int progressCallback(void *pArg) {
+  return wasm_progress((sqlite3*)pArg);
+}
+
+/*
+** wasm_progress_handler calls wasm_progress every nOps virtual machine
+** instructions run by db, or never again if nOps is 0 or less
+*/
+void wasm_progress_handler(sqlite3 *db, int nOps) {
+  if( nOps>0 ){
+    sqlite3_progress_handler(db, nOps, progressCallback, (void*)db);
+  }else{
+    sqlite3_progress_handler(db, 0, 0, 0);
+  }
+}
@@ -0,0 +1,50 @@
+/*
+** wasm_scanstatus.c reads the sqlite3_stmt_scanstatus counters of every
+** loop of a statement in a single call, instead of one call per loop and
+** counter. Requires SQLITE_ENABLE_STMT_SCANSTATUS.
+*/
+
+#include <string.h>
+#include <sqlite3.h>
+
+/*
+** wasm_scan holds the counters of a single loop of a statement. It's 40 bytes
+** wide on wasm32 and it's layout must be kept in sync with lib/profile.js
+*/
+typedef struct wasm_scan wasm_scan;
+struct wasm_scan {
+  sqlite3_int64 nLoop;      /* SQLITE_SCANSTAT_NLOOP: number of times the loop was run */
+  sqlite3_int64 nVisit;     /* SQLITE_SCANSTAT_NVISIT: number of rows visited by the loop */
+  double rEst;              /* SQLITE_SCANSTAT_EST: estimated rows output per run of the loop */
+  const char *zName;        /* SQLITE_SCANSTAT_NAME: table or index scanned */
+  const char *zExplain;     /* SQLITE_SCANSTAT_EXPLAIN: EXPLAIN QUERY PLAN text of the loop */
+  int iSelectId;            /* SQLITE_SCANSTAT_SELECTID: id of the loop's EXPLAIN QUERY PLAN node */
+  int iPad;                 /* keeps the size a multiple of 8 */
+};
+
+/*
+** wasm_stmt_scanstatus fills aScan with the counters of up to nMax loops of pStmt
+** and returns the number of loops the statement has, which might be more than nMax.
+*/
+int wasm_stmt_scanstatus(sqlite3_stmt *pStmt, wasm_scan *aScan, int nMax) {
+#ifdef SQLITE_ENABLE_STMT_SCANSTATUS
+  int i;
+  for(i=0; ; i++){
+    wasm_scan scan;
+    memset(&scan, 0, sizeof(scan));
+    if( sqlite3_stmt_scanstatus(pStmt, i, SQLITE_SCANSTAT_NLOOP, (void*)&scan.nLoop) ) break;
+    if( i>=nMax ) continue;
+
+    sqlite3_stmt_scanstatus(pStmt, i, SQLITE_SCANSTAT_NVISIT, (void*)&scan.nVisit);
+    sqlite3_stmt_scanstatus(pStmt, i, SQLITE_SCANSTAT_EST, (void*)&scan.rEst);
+    sqlite3_stmt_scanstatus(pStmt, i, SQLITE_SCANSTAT_NAME, (void*)&scan.zName);
+    sqlite3_stmt_scanstatus(pStmt, i, SQLITE_SCANSTAT_EXPLAIN, (void*)&scan.zExplain);
+    sqlite3_stmt_scanstatus(pStmt, i, SQLITE_SCANSTAT_SELECTID, (void*)&scan.iSelectId);
+    aScan[i] = scan;
+  }
+  return i;
+#else
+  (void)pStmt; (void)aScan; (void)nMax;
+  return 0;
+#endif
+}
@@ -0,0 +1,73 @@
+/*
+** wasm_status.c toggles the collection of sqlite3's memory statistics at
+** runtime and reads the global (sqlite3_status64) and per connection
+** (sqlite3_db_status) counters in a single call each, instead of one call
+** per counter.
+*/
+
+#include <sqlite3.h>
+
+/*
+** The global counters read, in the order they are written out; must be kept in sync with lib/stats.js
+*/
+static const int aStatus[] = {
+  SQLITE_STATUS_MEMORY_USED,
+  SQLITE_STATUS_MALLOC_COUNT,
+  SQLITE_STATUS_MALLOC_SIZE,
+  SQLITE_STATUS_PAGECACHE_USED,
+  SQLITE_STATUS_PAGECACHE_OVERFLOW,
+  SQLITE_STATUS_PAGECACHE_SIZE,
+};
+
+/*
+** The per connection counters read, in the order they are written out; must be kept in sync with lib/stats.js
+*/
+static const int aDbStatus[] = {
+  SQLITE_DBSTATUS_LOOKASIDE_USED,
+  SQLITE_DBSTATUS_LOOKASIDE_HIT,
+  SQLITE_DBSTATUS_LOOKASIDE_MISS_SIZE,
+  SQLITE_DBSTATUS_LOOKASIDE_MISS_FULL,
+  SQLITE_DBSTATUS_CACHE_USED,
+  SQLITE_DBSTATUS_CACHE_HIT,
+  SQLITE_DBSTATUS_CACHE_MISS,
+  SQLITE_DBSTATUS_CACHE_WRITE,
+  SQLITE_DBSTATUS_CACHE_SPILL,
+  SQLITE_DBSTATUS_SCHEMA_USED,
+  SQLITE_DBSTATUS_STMT_USED,
+};
+
+/*
+** wasm_memstatus turns the collection of memory statistics on or off. The build
+** defaults to off (SQLITE_DEFAULT_MEMSTATUS=0), as it costs on every allocation.
+** It returns SQLITE_MISUSE once the library is initialized; it has to be shut
+** down first.
+*/
+int wasm_memstatus(int bEnable) {
+  return sqlite3_config(SQLITE_CONFIG_MEMSTATUS, bEnable);
+}
+
+/*
+** wasm_status fills aOut with the current and highwater values of every counter
+** listed in aStatus, resetting the highwater marks if bReset is true, and returns
+** the number of counters read.
+*/
+int wasm_status(sqlite3_int64 *aOut, int bReset) {
+  int i, n = (int)(sizeof(aStatus) / sizeof(aStatus[0]));
+  for(i=0; i<n; i++){
+    sqlite3_status64(aStatus[i], &aOut[2*i], &aOut[2*i+1], bReset);
+  }
+  return n;
+}
+
+/*
+** wasm_db_status fills aOut with the current and highwater values of every counter
+** of db listed in aDbStatus, resetting them if bReset is true, and returns the
+** number of counters read.
+*/
+int wasm_db_status(sqlite3 *db, int *aOut, int bReset) {
+  int i, n = (int)(sizeof(aDbStatus) / sizeof(aDbStatus[0]));
+  for(i=0; i<n; i++){
+    sqlite3_db_status(db, aDbStatus[i], &aOut[2*i], &aOut[2*i+1], bReset);
+  }
+  return n;
+}
@@ -0,0 +1,32 @@
+/*
+** wasm_stmt_status.c reads all the sqlite3_stmt_status counters of a
+** statement in a single call, instead of one call per counter, so that
+** they can be collected after every execution at little cost.
+*/
+
+#include <sqlite3.h>
+
+/*
+** The counters read, in the order they are written out; must be kept in sync with lib/statistics.js
+*/
+static const int aStatus[] = {
+  SQLITE_STMTSTATUS_FULLSCAN_STEP,
+  SQLITE_STMTSTATUS_SORT,
+  SQLITE_STMTSTATUS_AUTOINDEX,
+  SQLITE_STMTSTATUS_VM_STEP,
+  SQLITE_STMTSTATUS_REPREPARE,
+  SQLITE_STMTSTATUS_RUN,
+  SQLITE_STMTSTATUS_MEMUSED,
+};
+
+/*
+** wasm_stmt_status fills aOut with the counters of pStmt listed in aStatus, resetting
+** them afterwards if bReset is true, and returns the number of counters written.
+*/
+int wasm_stmt_status(sqlite3_stmt *pStmt, int *aOut, int bReset) {
+  int i, n = (int)(sizeof(aStatus) / sizeof(aStatus[0]));
+  for(i=0; i<n; i++){
+    aOut[i] = sqlite3_stmt_status(pStmt, aStatus[i], bReset);
+  }
+  return n;
+}
@@ -0,0 +1,33 @@
+/*
+** wasm_trace.c reports the statements a connection runs to lib/trace.js,
+** using sqlite3_trace_v2, as they start and as they end. Unlike the spans
+** recorded around Statement#step, it covers every statement run, including
+** those run by sqlite3_exec and nested statements.
+*/
+
+#include <sqlite3.h>
+#include <os_wasm.h>
+
+/*
+** traceCallback is the sqlite3_trace_v2 callback. The start of a trigger is
+** reported with a comment in place of the sql; it's left out, as it doesn't
+** have an end of it's own.
+*/
+static int traceCallback(unsigned mask, void *pCtx, void *P, void *X) {
+  if( mask==SQLITE_TRACE_STMT ){
+    const char *zSql = (const char*)X;
+    if( zSql[0]!='-' || zSql[1]!='-' ) wasm_trace_statement(0, (sqlite3_stmt*)P, zSql);
+  }else if( mask==SQLITE_TRACE_PROFILE ){
+    wasm_trace_statement(1, (sqlite3_stmt*)P, 0);
+  }
+  return 0;
+}
+
+/*
+** wasm_trace turns the reporting of db's statements on or off
+*/
+int wasm_trace(sqlite3 *db, int bEnable) {
+  return bEnable ?
+    sqlite3_trace_v2(db, SQLITE_TRACE_STMT|SQLITE_TRACE_PROFILE, traceCallback, 0) :
+    sqlite3_trace_v2(db, 0, 0, 0);
+}
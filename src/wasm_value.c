@@ -0,0 +1,52 @@
+/*
+** wasm_value.c implements helpers to work with the
+** packed value format declared in wasm_value.h
+*/
+
+#include <stdint.h>
+#include <sqlite3.h>
+#include <wasm_value.h>
+
+int wasm_value_bind(sqlite3_stmt *pStmt, int i, const wasm_value *p, const char *zBase, void(*xDel)(void*)) {
+  switch( p->eType ){
+    case SQLITE_INTEGER: return sqlite3_bind_int64(pStmt, i, p->u.i);
+    case SQLITE_FLOAT:   return sqlite3_bind_double(pStmt, i, p->u.r);
+    case SQLITE_TEXT:    return sqlite3_bind_text(pStmt, i, zBase + p->u.iOffset, p->n, xDel);
+    case WASM_TEXT16:    return sqlite3_bind_text16(pStmt, i, zBase + p->u.iOffset, p->n, xDel);
+    case SQLITE_BLOB:    return sqlite3_bind_blob(pStmt, i, zBase + p->u.iOffset, p->n, xDel);
+    case SQLITE_NULL:    return sqlite3_bind_null(pStmt, i);
+    case WASM_SKIP:      return SQLITE_OK;
+    default:             return SQLITE_MISMATCH;
+  }
+}
+
+void wasm_value_from(sqlite3_value *pVal, wasm_value *p) {
+  p->eType = sqlite3_value_type(pVal);
+  p->n = 0;
+  switch( p->eType ){
+    case SQLITE_INTEGER: p->u.i = sqlite3_value_int64(pVal); break;
+    case SQLITE_FLOAT:   p->u.r = sqlite3_value_double(pVal); break;
+    case SQLITE_TEXT: {
+      p->u.iOffset = (int)(intptr_t)sqlite3_value_text(pVal);
+      p->n = sqlite3_value_bytes(pVal);
+      break;
+    }
+    case SQLITE_BLOB: {
+      p->u.iOffset = (int)(intptr_t)sqlite3_value_blob(pVal);
+      p->n = sqlite3_value_bytes(pVal);
+      break;
+    }
+    default: p->u.i = 0; break;
+  }
+}
+
+void wasm_value_result(sqlite3_context *ctx, const wasm_value *p, const char *zBase, void(*xDel)(void*)) {
+  switch( p->eType ){
+    case SQLITE_INTEGER: sqlite3_result_int64(ctx, p->u.i); break;
+    case SQLITE_FLOAT:   sqlite3_result_double(ctx, p->u.r); break;
+    case SQLITE_TEXT:    sqlite3_result_text(ctx, zBase + p->u.iOffset, p->n, xDel); break;
+    case WASM_TEXT16:    sqlite3_result_text16(ctx, zBase + p->u.iOffset, p->n, xDel); break;
+    case SQLITE_BLOB:    sqlite3_result_blob(ctx, zBase + p->u.iOffset, p->n, xDel); break;
+    default:             sqlite3_result_null(ctx); break;
+  }
+}
@@ -0,0 +1,56 @@
+/*
+** This file declares the packed value format used to move
+** whole sets of values between Javascript and WebAssembly in
+** a single call, instead of one call per value.
+**
+** A packed buffer is an array of fixed-size wasm_value slots, optionally
+** followed by the bytes of TEXT and BLOB values. Those bytes are referenced
+** by their offset relative to a base pointer (usually the start of the buffer).
+** See: lib/packer.js for the Javascript side of the format.
+*/
+
+#pragma once
+
+#include <sqlite3.h>
+
+/*
+** Slot types other than the fundamental sqlite3 datatypes
+** (SQLITE_INTEGER, SQLITE_FLOAT, SQLITE_TEXT, SQLITE_BLOB and SQLITE_NULL)
+*/
+#define WASM_SKIP   0     /* no value; leave the parameter untouched */
+#define WASM_TEXT16 6     /* TEXT value encoded as native byte-order UTF-16 */
+
+/*
+** wasm_value is a single slot in a packed buffer. It's 16 bytes wide
+** on wasm32 and it's layout must be kept in sync with lib/packer.js
+*/
+typedef struct wasm_value wasm_value;
+struct wasm_value {
+  int eType;              /* One of the SQLITE_* datatypes or WASM_* slot types */
+  int n;                  /* Size in bytes of TEXT, TEXT16 and BLOB values */
+  union {
+    sqlite3_int64 i;      /* SQLITE_INTEGER */
+    double r;             /* SQLITE_FLOAT */
+    int iOffset;          /* SQLITE_TEXT, WASM_TEXT16 and SQLITE_BLOB: offset of the bytes from base */
+  } u;
+};
+
+/*
+** wasm_value_bind binds the packed value p to the i-th parameter of pStmt.
+** Bytes of TEXT and BLOB values are read relative to zBase and passed on to sqlite3
+** along with xDel (SQLITE_STATIC or SQLITE_TRANSIENT).
+*/
+int wasm_value_bind(sqlite3_stmt *pStmt, int i, const wasm_value *p, const char *zBase, void(*xDel)(void*));
+
+/*
+** wasm_value_from packs the sqlite3_value pVal into p. Bytes of TEXT and BLOB values
+** are not copied; their offset is the absolute address of the bytes (ie. relative to 0)
+** and so they remain valid only as long as pVal does.
+*/
+void wasm_value_from(sqlite3_value *pVal, wasm_value *p);
+
+/*
+** wasm_value_result sets the packed value p as the result of ctx. Bytes of TEXT and BLOB
+** values are read relative to zBase and passed on to sqlite3 along with xDel.
+*/
+void wasm_value_result(sqlite3_context *ctx, const wasm_value *p, const char *zBase, void(*xDel)(void*));
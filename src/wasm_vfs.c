@@ -49,14 +49,15 @@ static int httpRandomness(sqlite3_vfs* vfs, int nByte, char *zOut) {
 }
 
 /*
-** Return the current time as Julian day converted into seconds.
+** Return the current time as Julian day converted into milliseconds.
 ** It uses an interface provided over wasm to use javascript api to get current time as unix epoch.
+** Millisecond precision matters to anything timing itself using the vfs, such as speedtest1.
 */
 static int httpCurrentTimeInt64(sqlite3_vfs* vfs, sqlite3_int64* piNow) {
   UNUSED(vfs);
   static const sqlite3_int64 unixEpoch = 24405875*(sqlite3_int64)8640000;
   sqlite3_int64 t = wasm_get_unix_epoch();
-  *piNow = (t * 1000) + unixEpoch;
+  *piNow = t + unixEpoch;
   return SQLITE_OK;
 }
 
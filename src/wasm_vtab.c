@@ -0,0 +1,422 @@
+/*
+** wasm_vtab.c implements an sqlite3 virtual table module whose tables
+** are backed by Javascript, modeled after the generate_series module in
+** ext/misc/series.c.
+**
+** xBestIndex flattens sqlite3_index_info into plain integer arrays that
+** Javascript reads and fills in directly. xFilter hands the constraint values
+** chosen by the plan over to Javascript, which is expected to skip rows that
+** can't match before they ever cross into wasm. Rows then come back in batches
+** of packed wasm_value slots (see wasm_value.h), so that xNext and xColumn only
+** call into Javascript once per batch rather than once per row or value.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sqlite3.h>
+#include <os_wasm.h>
+#include <wasm_value.h>
+
+#ifndef SQLITE_OMIT_VIRTUALTABLE
+
+/*
+** wasm_module is the client data of every module registered
+** through wasm_create_module
+*/
+typedef struct wasm_module wasm_module;
+struct wasm_module {
+  int id;                 /* Identifier of the Javascript implementation */
+  int nBatch;             /* Maximum number of rows fetched per call into Javascript */
+};
+
+/*
+** wasm_vtab is a single virtual table of a wasm_module
+*/
+typedef struct wasm_vtab wasm_vtab;
+struct wasm_vtab {
+  sqlite3_vtab base;      /* Base class - must be first */
+  int iTable;             /* Identifier of the Javascript table instance */
+  int nBatch;             /* Copied from wasm_module */
+};
+
+/*
+** Number of integers per constraint in the array handed over to
+** wasm_vtab_best_index: iColumn, op, usable, binary collation (inputs)
+** followed by argvIndex and omit (outputs)
+*/
+#define WASM_CONSTRAINT_SIZE 6
+
+/*
+** wasm_index_plan receives the outputs of xBestIndex other than the constraint
+** usage. It's layout must be kept in sync with lib/vtab.js
+*/
+typedef struct wasm_index_plan wasm_index_plan;
+struct wasm_index_plan {
+  int idxNum;             /* Passed on to xFilter */
+  int orderByConsumed;    /* True if rows come out in the requested order */
+  double estimatedCost;
+  double estimatedRows;
+  wasm_value idxStr;      /* TEXT allocated with malloc, or NULL; passed on to xFilter */
+};
+
+/*
+** wasm_vtab_batch receives a batch of rows from wasm_vtab_fill: nRow rows of
+** nCol slots each, in a buffer allocated by Javascript using malloc. It's layout
+** must be kept in sync with lib/vtab.js
+*/
+typedef struct wasm_vtab_batch wasm_vtab_batch;
+struct wasm_vtab_batch {
+  char *zBuf;             /* Packed rows; offsets of TEXT and BLOB bytes are relative to zBuf */
+  int nRow;               /* Number of rows in zBuf */
+  int nCol;               /* Number of slots per row */
+};
+
+/*
+** wasm_vtab_cursor is a cursor over rows of a wasm_vtab
+*/
+typedef struct wasm_vtab_cursor wasm_vtab_cursor;
+struct wasm_vtab_cursor {
+  sqlite3_vtab_cursor base;  /* Base class - must be first */
+  int iCursor;               /* Identifier of the Javascript iterator; 0 until first filtered */
+  int iRow;                  /* Current row within batch */
+  int bDone;                 /* True once Javascript has no more rows */
+  sqlite3_int64 iRowid;      /* The rowid; position of the row within the scan */
+  wasm_vtab_batch batch;     /* Current batch of rows */
+};
+
+/*
+** Copy the error message packed into p by Javascript into memory obtained
+** from sqlite3_malloc, releasing it's bytes
+*/
+static char *wasmVtabMessage(wasm_value *p) {
+  char *zMsg;
+  if( p->eType==SQLITE_TEXT ){
+    zMsg = sqlite3_mprintf("%.*s", p->n, (const char*)(intptr_t)p->u.iOffset);
+    free((void*)(intptr_t)p->u.iOffset);
+  }else{
+    zMsg = sqlite3_mprintf("javascript module failed");
+  }
+  return zMsg;
+}
+
+/*
+** Report the error packed into p as the error of the virtual table
+*/
+static int wasmVtabError(sqlite3_vtab *pVtab, wasm_value *p, int rc) {
+  sqlite3_free(pVtab->zErrMsg);
+  pVtab->zErrMsg = wasmVtabMessage(p);
+  return rc;
+}
+
+/*
+** xConnect and xCreate. Javascript provides the schema of the table
+** given the module arguments.
+*/
+static int wasmVtabConnect(
+  sqlite3 *db,
+  void *pAux,
+  int argc, const char *const*argv,
+  sqlite3_vtab **ppVtab,
+  char **pzErr
+){
+  wasm_module *pMod = (wasm_module*)pAux;
+  wasm_vtab *pNew;
+  wasm_value schema;
+  char *zSchema;
+  int iTable = 0, rc;
+
+  memset(&schema, 0, sizeof(schema));
+  rc = wasm_vtab_connect(pMod->id, argc, argv, &iTable, &schema);
+  if( rc!=SQLITE_OK ){
+    *pzErr = wasmVtabMessage(&schema);
+    return rc;
+  }
+  if( schema.eType!=SQLITE_TEXT ){
+    wasm_vtab_disconnect(iTable);
+    *pzErr = sqlite3_mprintf("javascript module returned no schema");
+    return SQLITE_ERROR;
+  }
+
+  zSchema = sqlite3_mprintf("%.*s", schema.n, (const char*)(intptr_t)schema.u.iOffset);
+  free((void*)(intptr_t)schema.u.iOffset);
+  if( zSchema==0 ){
+    wasm_vtab_disconnect(iTable);
+    return SQLITE_NOMEM;
+  }
+
+  rc = sqlite3_declare_vtab(db, zSchema);
+  sqlite3_free(zSchema);
+  if( rc==SQLITE_OK ){
+    pNew = (wasm_vtab*)sqlite3_malloc(sizeof(*pNew));
+    if( pNew==0 ) rc = SQLITE_NOMEM;
+  }
+  if( rc!=SQLITE_OK ){
+    wasm_vtab_disconnect(iTable);
+    return rc;
+  }
+
+  memset(pNew, 0, sizeof(*pNew));
+  pNew->iTable = iTable;
+  pNew->nBatch = pMod->nBatch;
+  *ppVtab = &pNew->base;
+  return SQLITE_OK;
+}
+
+/*
+** xDisconnect and xDestroy
+*/
+static int wasmVtabDisconnect(sqlite3_vtab *pVtab) {
+  wasm_vtab *p = (wasm_vtab*)pVtab;
+  wasm_vtab_disconnect(p->iTable);
+  sqlite3_free(p);
+  return SQLITE_OK;
+}
+
+/*
+** xBestIndex. Constraints and ORDER BY terms are flattened into integer arrays
+** for Javascript to pick the plan from; see WASM_CONSTRAINT_SIZE for the layout.
+*/
+static int wasmVtabBestIndex(sqlite3_vtab *pVtab, sqlite3_index_info *pIdxInfo) {
+  wasm_vtab *p = (wasm_vtab*)pVtab;
+  wasm_index_plan plan;
+  wasm_value err;
+  int *aCons, *aOrderBy;
+  int i, rc;
+
+  aCons = (int*)sqlite3_malloc64(sizeof(int)*(WASM_CONSTRAINT_SIZE*(sqlite3_uint64)pIdxInfo->nConstraint + 2*pIdxInfo->nOrderBy) + 1);
+  if( aCons==0 ) return SQLITE_NOMEM;
+  aOrderBy = &aCons[WASM_CONSTRAINT_SIZE*pIdxInfo->nConstraint];
+
+  for(i=0; i<pIdxInfo->nConstraint; i++){
+    int *a = &aCons[WASM_CONSTRAINT_SIZE*i];
+    const char *zColl = sqlite3_vtab_collation(pIdxInfo, i);
+    a[0] = pIdxInfo->aConstraint[i].iColumn;
+    a[1] = pIdxInfo->aConstraint[i].op;
+    a[2] = pIdxInfo->aConstraint[i].usable;
+    a[3] = zColl==0 || sqlite3_stricmp(zColl, "BINARY")==0;
+    a[4] = 0;
+    a[5] = 0;
+  }
+  for(i=0; i<pIdxInfo->nOrderBy; i++){
+    aOrderBy[2*i] = pIdxInfo->aOrderBy[i].iColumn;
+    aOrderBy[2*i+1] = pIdxInfo->aOrderBy[i].desc;
+  }
+
+  memset(&plan, 0, sizeof(plan));
+  memset(&err, 0, sizeof(err));
+  plan.estimatedCost = pIdxInfo->estimatedCost;
+  plan.estimatedRows = (double)pIdxInfo->estimatedRows;
+  rc = wasm_vtab_best_index(p->iTable, pIdxInfo->nConstraint, aCons, pIdxInfo->nOrderBy, aOrderBy, &plan, &err);
+  if( rc==SQLITE_OK ){
+    for(i=0; i<pIdxInfo->nConstraint; i++){
+      pIdxInfo->aConstraintUsage[i].argvIndex = aCons[WASM_CONSTRAINT_SIZE*i+4];
+      pIdxInfo->aConstraintUsage[i].omit = (unsigned char)aCons[WASM_CONSTRAINT_SIZE*i+5];
+    }
+    pIdxInfo->idxNum = plan.idxNum;
+    pIdxInfo->orderByConsumed = plan.orderByConsumed;
+    pIdxInfo->estimatedCost = plan.estimatedCost;
+    pIdxInfo->estimatedRows = (sqlite3_int64)plan.estimatedRows;
+    if( plan.idxStr.eType==SQLITE_TEXT ){
+      pIdxInfo->idxStr = sqlite3_mprintf("%.*s", plan.idxStr.n, (const char*)(intptr_t)plan.idxStr.u.iOffset);
+      pIdxInfo->needToFreeIdxStr = 1;
+      free((void*)(intptr_t)plan.idxStr.u.iOffset);
+      if( pIdxInfo->idxStr==0 ) rc = SQLITE_NOMEM;
+    }
+  }else if( rc!=SQLITE_CONSTRAINT ){
+    wasmVtabError(pVtab, &err, rc);
+  }
+
+  sqlite3_free(aCons);
+  return rc;
+}
+
+/*
+** xOpen
+*/
+static int wasmVtabOpen(sqlite3_vtab *pVtab, sqlite3_vtab_cursor **ppCursor) {
+  wasm_vtab_cursor *pCur = (wasm_vtab_cursor*)sqlite3_malloc(sizeof(*pCur));
+  if( pCur==0 ) return SQLITE_NOMEM;
+  memset(pCur, 0, sizeof(*pCur));
+  pCur->bDone = 1;
+  *ppCursor = &pCur->base;
+  return SQLITE_OK;
+}
+
+/*
+** xClose
+*/
+static int wasmVtabClose(sqlite3_vtab_cursor *cur) {
+  wasm_vtab_cursor *pCur = (wasm_vtab_cursor*)cur;
+  free(pCur->batch.zBuf);
+  if( pCur->iCursor ) wasm_vtab_close(pCur->iCursor);
+  sqlite3_free(pCur);
+  return SQLITE_OK;
+}
+
+/*
+** Release the current batch of the cursor and fetch the next one from Javascript
+*/
+static int wasmVtabFill(wasm_vtab_cursor *pCur) {
+  wasm_vtab *p = (wasm_vtab*)pCur->base.pVtab;
+  wasm_value err;
+  int rc;
+
+  free(pCur->batch.zBuf);
+  memset(&pCur->batch, 0, sizeof(pCur->batch));
+  pCur->iRow = 0;
+
+  memset(&err, 0, sizeof(err));
+  rc = wasm_vtab_fill(pCur->iCursor, p->nBatch, &pCur->batch, &err);
+  if( rc!=SQLITE_OK ){
+    pCur->bDone = 1;
+    return wasmVtabError(&p->base, &err, rc);
+  }
+  if( pCur->batch.nRow<p->nBatch ) pCur->bDone = 1; /* a short batch is the last one */
+  return SQLITE_OK;
+}
+
+/*
+** xFilter. Javascript starts a new scan for the plan idxNum / idxStr given the values
+** of the constraints that were assigned an argvIndex by xBestIndex.
+*/
+static int wasmVtabFilter(
+  sqlite3_vtab_cursor *cur,
+  int idxNum, const char *idxStr,
+  int argc, sqlite3_value **argv
+){
+  wasm_vtab_cursor *pCur = (wasm_vtab_cursor*)cur;
+  wasm_vtab *p = (wasm_vtab*)cur->pVtab;
+  wasm_value aStatic[8];
+  wasm_value *aArg = aStatic;
+  wasm_value err;
+  int i, rc;
+
+  if( argc>(int)(sizeof(aStatic)/sizeof(aStatic[0])) ){
+    aArg = (wasm_value*)sqlite3_malloc64(sizeof(wasm_value)*argc);
+    if( aArg==0 ) return SQLITE_NOMEM;
+  }
+  for(i=0; i<argc; i++){
+    wasm_value_from(argv[i], &aArg[i]);
+  }
+
+  memset(&err, 0, sizeof(err));
+  rc = wasm_vtab_filter(p->iTable, &pCur->iCursor, idxNum, idxStr, argc, aArg, &err);
+  if( aArg!=aStatic ) sqlite3_free(aArg);
+
+  pCur->iRowid = 1;
+  if( rc!=SQLITE_OK ){
+    free(pCur->batch.zBuf);
+    memset(&pCur->batch, 0, sizeof(pCur->batch));
+    pCur->bDone = 1;
+    return wasmVtabError(cur->pVtab, &err, rc);
+  }
+
+  pCur->bDone = 0;
+  return wasmVtabFill(pCur);
+}
+
+/*
+** xNext. Only calls into Javascript once the current batch is exhausted.
+*/
+static int wasmVtabNext(sqlite3_vtab_cursor *cur) {
+  wasm_vtab_cursor *pCur = (wasm_vtab_cursor*)cur;
+  pCur->iRow++;
+  pCur->iRowid++;
+  if( pCur->iRow>=pCur->batch.nRow && !pCur->bDone ){
+    return wasmVtabFill(pCur);
+  }
+  return SQLITE_OK;
+}
+
+/*
+** xEof
+*/
+static int wasmVtabEof(sqlite3_vtab_cursor *cur) {
+  wasm_vtab_cursor *pCur = (wasm_vtab_cursor*)cur;
+  return pCur->iRow>=pCur->batch.nRow;
+}
+
+/*
+** xColumn. Columns missing from a row are NULL.
+*/
+static int wasmVtabColumn(sqlite3_vtab_cursor *cur, sqlite3_context *ctx, int i) {
+  wasm_vtab_cursor *pCur = (wasm_vtab_cursor*)cur;
+  wasm_vtab_batch *pBatch = &pCur->batch;
+  if( i>=0 && i<pBatch->nCol ){
+    const wasm_value *aSlot = (const wasm_value*)pBatch->zBuf;
+    wasm_value_result(ctx, &aSlot[pCur->iRow*pBatch->nCol + i], pBatch->zBuf, SQLITE_TRANSIENT);
+  }else{
+    sqlite3_result_null(ctx);
+  }
+  return SQLITE_OK;
+}
+
+/*
+** xRowid. Rows are numbered from 1 in the order they are returned by the scan.
+*/
+static int wasmVtabRowid(sqlite3_vtab_cursor *cur, sqlite_int64 *pRowid) {
+  wasm_vtab_cursor *pCur = (wasm_vtab_cursor*)cur;
+  *pRowid = pCur->iRowid;
+  return SQLITE_OK;
+}
+
+/*
+** Destructor of the wasm_module client data
+*/
+static void wasmModuleDestroy(void *p) {
+  wasm_module *pMod = (wasm_module*)p;
+  wasm_module_destroy(pMod->id);
+  sqlite3_free(pMod);
+}
+
+/*
+** This following structure defines all the methods of Javascript-backed
+** virtual tables. As xCreate and xConnect are the same, tables can be created
+** with CREATE VIRTUAL TABLE ... USING as well as used as eponymous tables.
+*/
+static sqlite3_module wasmModule = {
+  0,                         /* iVersion */
+  wasmVtabConnect,           /* xCreate */
+  wasmVtabConnect,           /* xConnect */
+  wasmVtabBestIndex,         /* xBestIndex */
+  wasmVtabDisconnect,        /* xDisconnect */
+  wasmVtabDisconnect,        /* xDestroy */
+  wasmVtabOpen,              /* xOpen - open a cursor */
+  wasmVtabClose,             /* xClose - close a cursor */
+  wasmVtabFilter,            /* xFilter - configure scan constraints */
+  wasmVtabNext,              /* xNext - advance a cursor */
+  wasmVtabEof,               /* xEof - check for end of scan */
+  wasmVtabColumn,            /* xColumn - read data */
+  wasmVtabRowid,             /* xRowid - read data */
+  0,                         /* xUpdate */
+  0,                         /* xBegin */
+  0,                         /* xSync */
+  0,                         /* xCommit */
+  0,                         /* xRollback */
+  0,                         /* xFindMethod */
+  0,                         /* xRename */
+  0,                         /* xSavepoint */
+  0,                         /* xRelease */
+  0,                         /* xRollbackTo */
+  0                          /* xShadowName */
+};
+
+/*
+** wasm_create_module registers the Javascript module identified by id as zName.
+** Cursors fetch up to nBatch rows per call into Javascript. The Javascript
+** implementation is released through wasm_module_destroy even if registering
+** the module fails.
+*/
+int wasm_create_module(sqlite3 *db, const char *zName, int id, int nBatch) {
+  wasm_module *pMod = (wasm_module*)sqlite3_malloc(sizeof(wasm_module));
+  if( pMod==0 ){
+    wasm_module_destroy(id);
+    return SQLITE_NOMEM;
+  }
+  pMod->id = id;
+  pMod->nBatch = nBatch>0 ? nBatch : 1;
+  return sqlite3_create_module_v2(db, zName, &wasmModule, pMod, wasmModuleDestroy);
+}
+
+#endif /* SQLITE_OMIT_VIRTUALTABLE */
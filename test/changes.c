@@ -0,0 +1,106 @@
+/*
+** changes.c checks that the change feed of src/wasm_hooks.c never reports
+** changes that were rolled back, as when an executeMany (see lib/connection.js)
+** fails half-way: the rows it inserted before the failure are undone with
+** ROLLBACK TO, which doesn't fire the rollback hook. It's built natively,
+** with wasm_changes_commit standing in for the Javascript listener, and
+** exits with a non-zero status on failure.
+*/
+
+#include <stdio.h>
+#include <sqlite3.h>
+
+int wasm_changes_open(sqlite3 *db, int id, int nCapacity);
+void wasm_changes_close(sqlite3 *db);
+int wasm_changes_savepoint(sqlite3 *db);
+void wasm_changes_rollback_to(sqlite3 *db);
+void wasm_changes_release(sqlite3 *db);
+
+/* number of transactions reported, and the number of changes reported last */
+static int nCommit = 0;
+static int nEntry = 0;
+
+/*
+** Stands in for lib/changes.js#wasm_changes_commit; nEntry is the first field of a wasm_changes
+*/
+void wasm_changes_commit(int id, void *pChanges) {
+  nCommit++;
+  nEntry = *(int*)pChanges;
+}
+
+static int nFail = 0;
+
+static void check(int bOk, const char *zWhat) {
+  if( !bOk ){
+    fprintf(stderr, "FAIL: %s (%d transactions reported, %d changes)\n", zWhat, nCommit, nEntry);
+    nFail++;
+  }
+}
+
+static void exec(sqlite3 *db, const char *zSql, int rcExpected) {
+  int rc = sqlite3_exec(db, zSql, 0, 0, 0);
+  if( rc!=rcExpected ){
+    fprintf(stderr, "FAIL: %s returned %d: %s\n", zSql, rc, sqlite3_errmsg(db));
+    nFail++;
+  }
+}
+
+int main(void) {
+  sqlite3 *db;
+  int rc;
+  sqlite3_initialize(); /* the build defines SQLITE_OMIT_AUTOINIT */
+  rc = sqlite3_open(":memory:", &db);
+  if( rc!=SQLITE_OK ){
+    fprintf(stderr, "FAIL: sqlite3_open returned %d\n", rc);
+    return 1;
+  }
+  exec(db, "CREATE TABLE t(a INTEGER PRIMARY KEY, b UNIQUE)", SQLITE_OK);
+  wasm_changes_open(db, 1, 16);
+
+  /* a batch failing half-way, as executeMany runs it */
+  exec(db, "SAVEPOINT execute_many", SQLITE_OK);
+  wasm_changes_savepoint(db);
+  exec(db, "INSERT INTO t(b) VALUES (1), (2)", SQLITE_OK);
+  exec(db, "INSERT INTO t(b) VALUES (3)", SQLITE_OK);
+  exec(db, "INSERT INTO t(b) VALUES (1)", SQLITE_CONSTRAINT);
+  exec(db, "ROLLBACK TO execute_many", SQLITE_OK);
+  wasm_changes_rollback_to(db);
+  exec(db, "RELEASE execute_many", SQLITE_OK);
+  wasm_changes_release(db);
+  check(nCommit==0, "a failed batch is reported");
+
+  /* the same, more changes than the capacity; they're dropped but must not be reported either */
+  exec(db, "SAVEPOINT execute_many", SQLITE_OK);
+  wasm_changes_savepoint(db);
+  exec(db, "WITH RECURSIVE n(i) AS (SELECT 10 UNION ALL SELECT i+1 FROM n WHERE i<50) INSERT INTO t(b) SELECT i FROM n", SQLITE_OK);
+  exec(db, "ROLLBACK TO execute_many", SQLITE_OK);
+  wasm_changes_rollback_to(db);
+  exec(db, "RELEASE execute_many", SQLITE_OK);
+  wasm_changes_release(db);
+  check(nCommit==0, "a failed batch past the capacity is reported");
+
+  /* a failed batch nested in a transaction that commits; only the changes of the transaction are reported */
+  exec(db, "BEGIN; INSERT INTO t(b) VALUES (100)", SQLITE_OK);
+  exec(db, "SAVEPOINT execute_many", SQLITE_OK);
+  wasm_changes_savepoint(db);
+  exec(db, "INSERT INTO t(b) VALUES (101), (102)", SQLITE_OK);
+  exec(db, "ROLLBACK TO execute_many", SQLITE_OK);
+  wasm_changes_rollback_to(db);
+  exec(db, "RELEASE execute_many", SQLITE_OK);
+  wasm_changes_release(db);
+  exec(db, "COMMIT", SQLITE_OK);
+  check(nCommit==1 && nEntry==1, "the changes of a failed batch are reported with the transaction");
+
+  /* a batch that succeeds is reported as a whole */
+  exec(db, "SAVEPOINT execute_many", SQLITE_OK);
+  wasm_changes_savepoint(db);
+  exec(db, "INSERT INTO t(b) VALUES (200), (201)", SQLITE_OK);
+  exec(db, "RELEASE execute_many", SQLITE_OK);
+  wasm_changes_release(db);
+  check(nCommit==2 && nEntry==2, "a successful batch isn't reported");
+
+  wasm_changes_close(db);
+  sqlite3_close(db);
+  if( nFail==0 ) printf("ok\n");
+  return nFail>0;
+}
@@ -0,0 +1,196 @@
+/*
+** typed_array.c checks the typed_array virtual table of ext/misc/typed_array.c
+** against small registered arrays: the rowid ranges pushed down into the scan
+** (bounds just in and out of range, clamped to the arrays, or not integers),
+** NULL text and blob values, and scans in descending order of rowid. Every
+** constraint is still checked by sqlite3, so a range narrowed too far shows up
+** as missing rows. It's built natively and exits with a non-zero status on
+** failure.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <sqlite3.h>
+
+/* mirrors typed_array_column of ext/misc/typed_array.c */
+typedef struct typed_array_column typed_array_column;
+struct typed_array_column {
+  const char *zName;
+  int eType;
+  const void *aData;
+  const int *aOffset;
+};
+
+#define TYPED_ARRAY_INT32    1
+#define TYPED_ARRAY_FLOAT64  3
+#define TYPED_ARRAY_TEXT     4
+#define TYPED_ARRAY_BLOB     5
+
+int sqlite3_typed_array_register(const char *zName, int nRow, int nCol, const typed_array_column *aCol);
+int sqlite3_typedarray_init(sqlite3 *db, char **pzErrMsg, const sqlite3_api_routines *pApi);
+
+/*
+** 5 rows, rowids 1 to 5. s is 'ab', NULL, '', 'cd', 'e' and b is
+** X'6162', X'6364', NULL, X'65', X''; a NULL's offset is stored as ~offset.
+*/
+static const int aI[] = { 10, 20, 30, 40, 50 };
+static const double aX[] = { 0.5, 1.5, 2.5, 3.5, 4.5 };
+static const char zData[] = "abcde";
+static const int aTextOffset[] = { 0, ~2, 2, 2, 4, 5 };
+static const int aBlobOffset[] = { 0, 2, ~4, 4, 5, 5 };
+
+static const typed_array_column aCol[] = {
+  { "i", TYPED_ARRAY_INT32, aI, 0 },
+  { "x", TYPED_ARRAY_FLOAT64, aX, 0 },
+  { "s", TYPED_ARRAY_TEXT, zData, aTextOffset },
+  { "b", TYPED_ARRAY_BLOB, zData, aBlobOffset },
+};
+
+static int nFail = 0;
+
+/*
+** Runs zSql and checks the values of it's first column, joined with commas, against zExpected
+*/
+static void check(sqlite3 *db, const char *zSql, const char *zExpected) {
+  sqlite3_stmt *pStmt;
+  char zOut[256];
+  int n = 0, rc;
+
+  zOut[0] = 0;
+  rc = sqlite3_prepare_v2(db, zSql, -1, &pStmt, 0);
+  if( rc!=SQLITE_OK ){
+    fprintf(stderr, "FAIL: %s: %s\n", zSql, sqlite3_errmsg(db));
+    nFail++;
+    return;
+  }
+  while( (rc = sqlite3_step(pStmt))==SQLITE_ROW ){
+    const char *z = (const char*)sqlite3_column_text(pStmt, 0);
+    n += snprintf(zOut+n, sizeof(zOut)-n, "%s%s", n>0 ? "," : "", z ? z : "NULL");
+    if( n>=(int)sizeof(zOut) ) n = sizeof(zOut)-1;
+  }
+  if( rc!=SQLITE_DONE ){
+    fprintf(stderr, "FAIL: %s: %s\n", zSql, sqlite3_errmsg(db));
+    nFail++;
+  }else if( strcmp(zOut, zExpected)!=0 ){
+    fprintf(stderr, "FAIL: %s returned [%s], expected [%s]\n", zSql, zOut, zExpected);
+    nFail++;
+  }
+  sqlite3_finalize(pStmt);
+}
+
+/*
+** Checks that sqlite3 doesn't sort the rows of zSql itself, as the scan returns them in order
+*/
+static void checkSorted(sqlite3 *db, const char *zSql) {
+  sqlite3_stmt *pStmt;
+  char *zPlan = sqlite3_mprintf("EXPLAIN QUERY PLAN %s", zSql);
+  int rc = sqlite3_prepare_v2(db, zPlan, -1, &pStmt, 0);
+  sqlite3_free(zPlan);
+  if( rc!=SQLITE_OK ){
+    fprintf(stderr, "FAIL: %s: %s\n", zSql, sqlite3_errmsg(db));
+    nFail++;
+    return;
+  }
+  while( sqlite3_step(pStmt)==SQLITE_ROW ){
+    const char *zDetail = (const char*)sqlite3_column_text(pStmt, 3);
+    if( zDetail && strstr(zDetail, "B-TREE FOR ORDER BY") ){
+      fprintf(stderr, "FAIL: %s is sorted by sqlite3\n", zSql);
+      nFail++;
+    }
+  }
+  sqlite3_finalize(pStmt);
+}
+
+int main(void) {
+  sqlite3 *db;
+  int rc;
+  sqlite3_initialize(); /* the build defines SQLITE_OMIT_AUTOINIT */
+  rc = sqlite3_open(":memory:", &db);
+  if( rc!=SQLITE_OK ){
+    fprintf(stderr, "FAIL: sqlite3_open returned %d\n", rc);
+    return 1;
+  }
+  sqlite3_typedarray_init(db, 0, 0);
+  sqlite3_typed_array_register("t", 5, 4, aCol);
+  rc = sqlite3_exec(db, "CREATE VIRTUAL TABLE temp.t USING typed_array(t)", 0, 0, 0);
+  if( rc!=SQLITE_OK ){
+    fprintf(stderr, "FAIL: CREATE VIRTUAL TABLE: %s\n", sqlite3_errmsg(db));
+    return 1;
+  }
+
+  check(db, "SELECT i FROM t", "10,20,30,40,50");
+
+  /* rowid = */
+  check(db, "SELECT i FROM t WHERE rowid=1", "10");
+  check(db, "SELECT i FROM t WHERE rowid=5", "50");
+  check(db, "SELECT i FROM t WHERE rowid=0", "");
+  check(db, "SELECT i FROM t WHERE rowid=6", "");
+  check(db, "SELECT i FROM t WHERE rowid=-1", "");
+  check(db, "SELECT i FROM t WHERE rowid=2.5", "");
+  check(db, "SELECT i FROM t WHERE rowid=2.0", "20");
+  check(db, "SELECT i FROM t WHERE rowid=NULL", "");
+
+  /* rowid > and >= */
+  check(db, "SELECT i FROM t WHERE rowid>0", "10,20,30,40,50");
+  check(db, "SELECT i FROM t WHERE rowid>-3", "10,20,30,40,50");
+  check(db, "SELECT i FROM t WHERE rowid>4", "50");
+  check(db, "SELECT i FROM t WHERE rowid>5", "");
+  check(db, "SELECT i FROM t WHERE rowid>2.5", "30,40,50");
+  check(db, "SELECT i FROM t WHERE rowid>9223372036854775807", "");
+  check(db, "SELECT i FROM t WHERE rowid>=1", "10,20,30,40,50");
+  check(db, "SELECT i FROM t WHERE rowid>=5", "50");
+  check(db, "SELECT i FROM t WHERE rowid>=6", "");
+  check(db, "SELECT i FROM t WHERE rowid>=2.5", "30,40,50");
+  check(db, "SELECT i FROM t WHERE rowid>=-1e300", "10,20,30,40,50");
+  check(db, "SELECT i FROM t WHERE rowid>=1e300", "");
+
+  /* rowid < and <= */
+  check(db, "SELECT i FROM t WHERE rowid<2", "10");
+  check(db, "SELECT i FROM t WHERE rowid<1", "");
+  check(db, "SELECT i FROM t WHERE rowid<0", "");
+  check(db, "SELECT i FROM t WHERE rowid<6", "10,20,30,40,50");
+  check(db, "SELECT i FROM t WHERE rowid<100", "10,20,30,40,50");
+  check(db, "SELECT i FROM t WHERE rowid<2.5", "10,20");
+  check(db, "SELECT i FROM t WHERE rowid<=1", "10");
+  check(db, "SELECT i FROM t WHERE rowid<=0", "");
+  check(db, "SELECT i FROM t WHERE rowid<=5", "10,20,30,40,50");
+  check(db, "SELECT i FROM t WHERE rowid<=2.5", "10,20");
+  check(db, "SELECT i FROM t WHERE rowid<=-9223372036854775808", "");
+  check(db, "SELECT i FROM t WHERE rowid<=1e300", "10,20,30,40,50");
+
+  /* both bounds */
+  check(db, "SELECT i FROM t WHERE rowid BETWEEN 2 AND 4", "20,30,40");
+  check(db, "SELECT i FROM t WHERE rowid>1.5 AND rowid<3.5", "20,30");
+  check(db, "SELECT i FROM t WHERE rowid>3 AND rowid<3", "");
+  check(db, "SELECT i FROM t WHERE rowid>=0 AND rowid<=6", "10,20,30,40,50");
+
+  /* NULL text and blob values */
+  check(db, "SELECT quote(s) FROM t", "'ab',NULL,'','cd','e'");
+  check(db, "SELECT quote(b) FROM t", "X'6162',X'6364',NULL,X'65',X''");
+  check(db, "SELECT rowid FROM t WHERE s IS NULL", "2");
+  check(db, "SELECT rowid FROM t WHERE s=''", "3");
+  check(db, "SELECT rowid FROM t WHERE s='cd'", "4");
+  check(db, "SELECT rowid FROM t WHERE b IS NULL", "3");
+  check(db, "SELECT rowid FROM t WHERE b=X''", "5");
+  check(db, "SELECT rowid FROM t WHERE b=X'6364'", "2");
+  check(db, "SELECT count(s) || ',' || count(b) FROM t", "4,4");
+
+  /* descending order of rowid, with and without a range */
+  check(db, "SELECT i FROM t ORDER BY rowid DESC", "50,40,30,20,10");
+  check(db, "SELECT i FROM t WHERE rowid BETWEEN 2 AND 4 ORDER BY rowid DESC", "40,30,20");
+  check(db, "SELECT i FROM t WHERE rowid>3 ORDER BY rowid DESC", "50,40");
+  check(db, "SELECT i FROM t WHERE rowid<=2.5 ORDER BY rowid DESC", "20,10");
+  check(db, "SELECT rowid FROM t WHERE s IS NOT NULL ORDER BY rowid DESC", "5,4,3,1");
+  checkSorted(db, "SELECT i FROM t ORDER BY rowid DESC");
+  checkSorted(db, "SELECT i FROM t WHERE rowid>3 ORDER BY rowid DESC");
+
+  /* bounds are clamped to the arrays as registered when the scan starts */
+  sqlite3_typed_array_register("t", 2, 4, aCol);
+  check(db, "SELECT i FROM t WHERE rowid<=6", "10,20");
+  check(db, "SELECT i FROM t WHERE rowid>=2 ORDER BY rowid DESC", "20");
+  check(db, "SELECT i FROM t WHERE rowid=3", "");
+
+  sqlite3_close(db);
+  if( nFail==0 ) printf("ok\n");
+  return nFail>0;
+}